@@ -0,0 +1,115 @@
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <cstdint>
+#include <numeric>
+#include <optional>
+#include <random>
+#include <vector>
+
+#include "index/btree.h"
+
+namespace {
+
+template <typename LeafLayoutT>
+using LayoutBTree =
+    buzzdb::BTree<uint64_t, uint64_t, std::less<uint64_t>, 1024,
+                  buzzdb::BinarySearch, buzzdb::SortedInnerLayout,
+                  LeafLayoutT>;  // NOLINT
+
+using InMemoryBTree =
+    buzzdb::BTree<uint64_t, uint64_t, std::less<uint64_t>, 1024,
+                  buzzdb::BinarySearch, buzzdb::SortedInnerLayout,
+                  buzzdb::SoALeafLayout, buzzdb::InMemoryStorage>;  // NOLINT
+
+constexpr uint64_t kTreeSize = 100000;
+
+/// Random point lookups, the workload of a pure key/value index.
+template <typename LeafLayoutT>
+void BM_PointLookup(benchmark::State& state) {
+  buzzdb::BufferManager buffer_manager(1024, 100);
+  LayoutBTree<LeafLayoutT> tree(0, buffer_manager);
+  std::vector<uint64_t> keys(kTreeSize);
+  std::iota(keys.begin(), keys.end(), 0);
+  std::mt19937_64 engine(0);
+  std::shuffle(keys.begin(), keys.end(), engine);
+  for (auto key : keys) {
+    tree.insert(key, key);
+  }
+
+  size_t i = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(tree.lookup(keys[i]));
+    i = (i + 1) % keys.size();
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+
+/// Sequential passes over full leaves, the inner loop of a range scan that
+/// filters on the key and sums the qualifying values.
+template <typename LeafLayoutT>
+void BM_LeafScan(benchmark::State& state) {
+  using LeafNode = typename LayoutBTree<LeafLayoutT>::LeafNode;
+  std::vector<std::byte> pages(64 * 1024);
+  std::vector<LeafNode*> leaves;
+  for (size_t offset = 0; offset < pages.size(); offset += 1024) {
+    auto* leaf = new (pages.data() + offset) LeafNode();
+    for (uint64_t k = 0; k < LeafNode::kCapacity; ++k) {
+      leaf->insert(k, k);
+    }
+    leaves.push_back(leaf);
+  }
+
+  uint64_t bound = LeafNode::kCapacity / 2;
+  for (auto _ : state) {
+    uint64_t sum = 0;
+    for (auto* leaf : leaves) {
+      for (uint32_t slot = 0; slot < leaf->count; ++slot) {
+        if (leaf->key_at(slot) < bound) {
+          sum += leaf->value_at(slot);
+        }
+      }
+    }
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * leaves.size() *
+                          LeafNode::kCapacity);
+}
+
+/// Random point lookups in batches, with interleaved descents of
+/// `state.range(0)` lookups at a time.
+void BM_InterleavedLookup(benchmark::State& state) {
+  constexpr size_t kBatchSize = 256;
+  buzzdb::BufferManager buffer_manager(1024, 100);
+  InMemoryBTree tree(0, buffer_manager);
+  std::vector<uint64_t> keys(kTreeSize * 10);
+  std::iota(keys.begin(), keys.end(), 0);
+  std::mt19937_64 engine(0);
+  std::shuffle(keys.begin(), keys.end(), engine);
+  for (auto key : keys) {
+    tree.insert(key, key);
+  }
+
+  std::vector<std::optional<uint64_t>> results(kBatchSize);
+  size_t i = 0;
+  for (auto _ : state) {
+    tree.lookup_interleaved(keys.data() + i, kBatchSize, results.data(),
+                            state.range(0));
+    benchmark::DoNotOptimize(results.data());
+    i = (i + kBatchSize) % (keys.size() - kBatchSize);
+  }
+  state.SetItemsProcessed(state.iterations() * kBatchSize);
+}
+
+}  // namespace
+
+BENCHMARK(BM_InterleavedLookup)->Arg(1)->Arg(4)->Arg(8)->Arg(16);
+BENCHMARK_TEMPLATE(BM_PointLookup, buzzdb::SoALeafLayout);
+BENCHMARK_TEMPLATE(BM_PointLookup, buzzdb::InterleavedLeafLayout);
+BENCHMARK_TEMPLATE(BM_PointLookup, buzzdb::FingerprintLeafLayout);
+BENCHMARK_TEMPLATE(BM_PointLookup, buzzdb::AdaptiveLeafLayout);
+BENCHMARK_TEMPLATE(BM_LeafScan, buzzdb::SoALeafLayout);
+BENCHMARK_TEMPLATE(BM_LeafScan, buzzdb::InterleavedLeafLayout);
+BENCHMARK_TEMPLATE(BM_LeafScan, buzzdb::FingerprintLeafLayout);
+BENCHMARK_TEMPLATE(BM_LeafScan, buzzdb::AdaptiveLeafLayout);
+
+BENCHMARK_MAIN();
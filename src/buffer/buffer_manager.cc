@@ -4,8 +4,10 @@
 /*
 This is only a dummy implementation of a buffer manager. It does not do any
 disk I/O or locking. It also does not respect the page_count and creates a new
-buffer for every fixed page and does so without using any latches so it is not
-thread-safe.
+buffer for every fixed page. Every partition of the page table is protected by
+a mutex, so pages can be fixed concurrently, but the pages are not latched.
+Evicted pages are kept in memory instead of being written to disk, their frames
+are freed once no reader is inside an epoch that could still reach them.
 */
 
 
@@ -23,18 +25,119 @@ BufferManager::BufferManager(size_t page_size, size_t /*page_count*/) : page_siz
 BufferManager::~BufferManager() = default;
 
 
-BufferFrame& BufferManager::fix_page(uint64_t page_id, bool /*exclusive*/) {
-    auto result = pages.emplace(page_id, BufferFrame{});
+BufferManager::PageTablePartition& BufferManager::partition_of(uint64_t page_id) {
+    // Mix the bits, the page ids of a segment are dense.
+    return partitions[((page_id * 0x9E3779B97F4A7C15ull) >> 32) % kPartitionCount];
+}
+
+
+BufferFrame& BufferManager::load_page(PageTablePartition& partition, uint64_t page_id) {
+    auto result = partition.pages.try_emplace(page_id);
     auto& page = result.first->second;
     bool is_new = result.second;
     if (is_new) {
-        page.data.resize(page_size, 0);
+        page.page_id = page_id;
+        auto evicted = partition.evicted.find(page_id);
+        if (evicted != partition.evicted.end()) {
+            page.data = std::move(evicted->second);
+            partition.evicted.erase(evicted);
+        } else {
+            page.data.resize(page_size, 0);
+        }
+    }
+    return page;
+}
+
+
+BufferFrame& BufferManager::fix_page(uint64_t page_id, bool /*exclusive*/) {
+    auto& partition = partition_of(page_id);
+    std::lock_guard<std::mutex> guard(partition.mutex);
+    auto& page = load_page(partition, page_id);
+    // Cancels an eviction of the page, see `evict_page()`.
+    uint32_t pins = page.pin_count.load(std::memory_order_relaxed);
+    while (!page.pin_count.compare_exchange_weak(pins, (pins & ~BufferFrame::kEvicting) + 1,
+                                                 std::memory_order_acquire)) {
     }
     return page;
 }
 
 
-void BufferManager::unfix_page(BufferFrame& /*page*/, bool /*is_dirty*/) {
+BufferFrame& BufferManager::read_page(uint64_t page_id) {
+    auto& partition = partition_of(page_id);
+    std::lock_guard<std::mutex> guard(partition.mutex);
+    return load_page(partition, page_id);
+}
+
+
+BufferFrame* BufferManager::try_fix_frame(BufferFrame& frame, bool /*exclusive*/) {
+    uint32_t pins = frame.pin_count.load(std::memory_order_relaxed);
+    do {
+        if (pins & BufferFrame::kEvicting) return nullptr;
+    } while (!frame.pin_count.compare_exchange_weak(pins, pins + 1, std::memory_order_acquire));
+    return &frame;
+}
+
+
+void BufferManager::unfix_page(BufferFrame& page, bool /*is_dirty*/) {
+    page.pin_count.fetch_sub(1, std::memory_order_release);
+}
+
+
+void BufferManager::set_eviction_handler(uint16_t segment_id,
+                                         std::function<bool(BufferFrame&)> handler) {
+    std::lock_guard<std::mutex> guard(eviction_handlers_mutex);
+    if (handler) {
+        eviction_handlers[segment_id] = std::move(handler);
+    } else {
+        eviction_handlers.erase(segment_id);
+    }
+}
+
+
+bool BufferManager::evict_page(uint64_t page_id) {
+    auto& partition = partition_of(page_id);
+    BufferFrame* frame;
+    {
+        std::lock_guard<std::mutex> guard(partition.mutex);
+        auto it = partition.pages.find(page_id);
+        if (it == partition.pages.end()) return false;
+        frame = &it->second;
+        // Only unpinned frames are evicted. From now on `try_fix_frame()`
+        // fails, only `fix_page()` can pin the frame, which cancels the
+        // eviction.
+        uint32_t unpinned = 0;
+        if (!frame->pin_count.compare_exchange_strong(unpinned, BufferFrame::kEvicting,
+                                                      std::memory_order_acquire)) {
+            return false;
+        }
+    }
+
+    // The handler may fix other pages, so the partition is not latched.
+    std::function<bool(BufferFrame&)> handler;
+    {
+        std::lock_guard<std::mutex> guard(eviction_handlers_mutex);
+        auto it = eviction_handlers.find(get_segment_id(page_id));
+        if (it != eviction_handlers.end()) handler = it->second;
+    }
+    bool evictable = !handler || handler(*frame);
+
+    std::lock_guard<std::mutex> guard(partition.mutex);
+    // Unless the page was fixed again while the handler ran, only this
+    // function changes the pin count now. The next access swizzles the
+    // reference in the parent again.
+    if (frame->pin_count.load(std::memory_order_acquire) != BufferFrame::kEvicting) return false;
+    if (!evictable) {
+        frame->pin_count.store(0, std::memory_order_release);
+        return false;
+    }
+    // Readers inside an epoch may still read the frame through a swizzled
+    // pointer or `read_page()`, so it keeps the content and the `kEvicting`
+    // tag until it is freed.
+    partition.evicted[page_id] = frame->data;
+    partition.retired.retire(partition.pages.extract(page_id), epoch_manager.current());
+    epoch_manager.advance();
+    partition.retired.reclaim(epoch_manager.oldest_active(), [](auto&&) {});
+    return true;
 }
 
 
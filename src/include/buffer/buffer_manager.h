@@ -1,11 +1,15 @@
 #pragma once
 
+#include <atomic>
 #include <cstddef>
 #include <cstdint>
 #include <exception>
+#include <functional>
+#include <mutex>
 #include <unordered_map>
 #include <vector>
 
+#include "common/epoch.h"
 
 namespace buzzdb {
 
@@ -13,11 +17,25 @@ class BufferFrame {
 private:
     friend class BufferManager;
 
+    /// Is added to the pin count while the frame is evicted, see `evict_page()`.
+    static constexpr uint32_t kEvicting = 1u << 31;
+
     std::vector<char> data;
+    uint64_t page_id = 0;
+    /// The number of fixes that were not unfixed yet, plus `kEvicting`.
+    std::atomic<uint32_t> pin_count{0};
 
 public:
+    BufferFrame() = default;
+
+    BufferFrame(const BufferFrame&) = delete;
+    BufferFrame& operator=(const BufferFrame&) = delete;
+
     /// Returns a pointer to this page's data.
     char* get_data();
+
+    /// Returns the page id of the page in this frame.
+    uint64_t get_page_id() const { return page_id; }
 };
 
 
@@ -32,8 +50,35 @@ public:
 
 class BufferManager {
 private:
+    /// A part of the page table with its own latch.
+    struct alignas(64) PageTablePartition {
+        std::mutex mutex;
+        std::unordered_map<uint64_t, BufferFrame> pages;
+        /// The content of the evicted pages of the partition.
+        std::unordered_map<uint64_t, std::vector<char>> evicted;
+        /// The frames of evicted pages. Readers that are inside an epoch may
+        /// still try to fix them through a swizzled pointer.
+        RetireList<std::unordered_map<uint64_t, BufferFrame>::node_type> retired;
+    };
+
+    /// The number of page table partitions.
+    static constexpr size_t kPartitionCount = 64;
+
     size_t page_size;
-    std::unordered_map<uint64_t, BufferFrame> pages;
+    /// The page table, partitioned by page id so that threads which fix
+    /// different pages rarely contend for a latch.
+    PageTablePartition partitions[kPartitionCount];
+    EpochManager epoch_manager;
+    /// Protects `eviction_handlers`.
+    std::mutex eviction_handlers_mutex;
+    std::unordered_map<uint16_t, std::function<bool(BufferFrame&)>> eviction_handlers;
+
+    /// Returns the page table partition of a page.
+    PageTablePartition& partition_of(uint64_t page_id);
+
+    /// Returns the frame of a page and loads the page if necessary. The mutex
+    /// of the partition must be held.
+    BufferFrame& load_page(PageTablePartition& partition, uint64_t page_id);
 
 public:
     /// Constructor.
@@ -48,6 +93,12 @@ public:
     /// Returns size of a page
     size_t get_page_size() { return page_size; }
 
+    /// Returns the epoch manager that is shared by all segments. Readers that
+    /// are inside an epoch may access the pages that a concurrent writer
+    /// retires until they exit it, page ids are only reused afterwards. The
+    /// frames of evicted pages are freed afterwards as well, see `read_page()`.
+    EpochManager& get_epoch_manager() { return epoch_manager; }
+
     /// Returns a reference to a `BufferFrame` object for a given page id. When
     /// the page is not loaded into memory, it is read from disk. Otherwise the
     /// loaded page is used.
@@ -61,11 +112,52 @@ public:
     ///                      non-exclusively (shared).
     BufferFrame& fix_page(uint64_t page_id, bool exclusive);
 
+    /// Returns the frame of a page like `fix_page()`, but without fixing it.
+    /// The caller must be inside an epoch of `get_epoch_manager()`: the page
+    /// may be evicted meanwhile, but its frame keeps the content and is only
+    /// freed after the epoch was exited. Writes to such a frame may be lost,
+    /// so it is only read, and there must be no concurrent writers of the
+    /// page.
+    /// @param[in] page_id   Page id of the page that should be read.
+    BufferFrame& read_page(uint64_t page_id);
+
+    /// Fixes the page in a frame that the caller reached without the page
+    /// table, e.g. through a swizzled pointer. Pins and latches the frame like
+    /// `fix_page()` and must be balanced by `unfix_page()` as well. Fails if
+    /// the frame is being evicted or was evicted, the caller then fixes the
+    /// page with `fix_page()`. The caller must be inside an epoch of
+    /// `get_epoch_manager()` since it read the pointer, so that the frame is
+    /// not freed meanwhile.
+    /// @param[in] frame     The frame of a page that was loaded.
+    /// @param[in] exclusive Whether the page is locked exclusively.
+    /// @return              The frame, or nullptr if it cannot be fixed.
+    BufferFrame* try_fix_frame(BufferFrame& frame, bool exclusive);
+
     /// Takes a `BufferFrame` reference that was returned by an earlier call to
     /// `fix_page()` and unfixes it. When `is_dirty` is / true, the page is
     /// written back to disk eventually.
     void unfix_page(BufferFrame& page, bool is_dirty);
 
+    /// Registers a function that is called before a page of a segment is
+    /// evicted. The function must drop all references to the frame, e.g.
+    /// swizzled pointers, and may refuse the eviction by returning false.
+    /// Meanwhile `try_fix_frame()` fails for the frame, so the function may
+    /// read the page as if it was fixed exclusively, and `fix_page()` cancels
+    /// the eviction.
+    /// An empty function removes the handler.
+    /// @param[in] segment_id The segment.
+    /// @param[in] handler    Called with the frame that is about to be evicted.
+    void set_eviction_handler(uint16_t segment_id,
+                              std::function<bool(BufferFrame&)> handler);
+
+    /// Writes a page back and removes its frame, the next `fix_page()` loads
+    /// it again. Pages that are fixed are not evicted. The frame is freed once
+    /// the readers that are inside an epoch have exited it.
+    /// @param[in] page_id   Page id of the page that should be evicted.
+    /// @return              Whether the page was evicted, false if it was not
+    ///                      loaded, is fixed or the eviction handler refused.
+    bool evict_page(uint64_t page_id);
+
     /// Returns the page ids of all pages (fixed and unfixed) that are in the
     /// FIFO list in FIFO order.
     /// Is not thread-safe.
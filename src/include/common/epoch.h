@@ -0,0 +1,153 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace buzzdb {
+
+/// Epoch-based reclamation.
+/// Readers enter the current global epoch before they access shared pages and
+/// exit it afterwards. Writers tag the pages they unlink with the global epoch
+/// and reuse them only once every reader that could still see them has exited.
+/// Every reader announces its epoch in a slot of its own cache line, so readers
+/// never write to a cache line that other readers use.
+class EpochManager {
+ public:
+  /// The number of readers that can be inside an epoch at the same time.
+  static constexpr size_t kSlotCount = 64;
+
+  /// Keeps a reader inside its epoch until it is destroyed.
+  class Guard {
+   public:
+    /// Constructor.
+    Guard(EpochManager& manager, size_t slot) : manager(&manager), slot(slot) {}
+
+    Guard(const Guard&) = delete;
+    Guard& operator=(const Guard&) = delete;
+    Guard& operator=(Guard&&) = delete;
+
+    Guard(Guard&& other) noexcept : manager(other.manager), slot(other.slot) {
+      other.manager = nullptr;
+    }
+
+    /// Destructor.
+    /// Exits the epoch.
+    ~Guard() {
+      if (manager) manager->exit(slot);
+    }
+
+   private:
+    /// The epoch manager, nullptr if the guard was moved away.
+    EpochManager* manager;
+    /// The slot that holds the epoch of the reader.
+    size_t slot;
+  };
+
+  EpochManager() = default;
+  EpochManager(const EpochManager&) = delete;
+  EpochManager& operator=(const EpochManager&) = delete;
+
+  /// Enters the current epoch.
+  /// Waits if all slots are in use.
+  Guard enter() {
+    static thread_local size_t hint =
+        std::hash<std::thread::id>{}(std::this_thread::get_id());
+    while (true) {
+      for (size_t i = 0; i < kSlotCount; ++i) {
+        size_t slot = (hint + i) % kSlotCount;
+        uint64_t expected = kInactive;
+        if (slots[slot].epoch.load(std::memory_order_relaxed) == kInactive &&
+            slots[slot].epoch.compare_exchange_strong(expected,
+                                                      global_epoch.load())) {
+          hint = slot;
+          return Guard(*this, slot);
+        }
+      }
+      std::this_thread::yield();
+    }
+  }
+
+  /// Returns the current global epoch.
+  uint64_t current() const { return global_epoch.load(); }
+
+  /// Starts a new global epoch.
+  /// @return The new epoch.
+  uint64_t advance() { return global_epoch.fetch_add(1) + 1; }
+
+  /// Returns the oldest epoch that a reader is inside of, or the current epoch
+  /// if there are no readers. Everything that was retired in an earlier epoch
+  /// can be reused.
+  uint64_t oldest_active() const {
+    uint64_t oldest = global_epoch.load();
+    for (auto& slot : slots) {
+      uint64_t epoch = slot.epoch.load();
+      if (epoch != kInactive && epoch < oldest) oldest = epoch;
+    }
+    return oldest;
+  }
+
+ private:
+  /// The epoch of a slot that is not in use.
+  static constexpr uint64_t kInactive = 0;
+
+  /// The epoch of one reader.
+  struct alignas(64) Slot {
+    std::atomic<uint64_t> epoch{kInactive};
+  };
+
+  /// Exits the epoch of a slot.
+  void exit(size_t slot) { slots[slot].epoch.store(kInactive); }
+
+  /// The global epoch.
+  alignas(64) std::atomic<uint64_t> global_epoch{1};
+  /// The slots of the readers.
+  Slot slots[kSlotCount];
+};
+
+/// Items that were retired in some epoch and can be reused once no reader is
+/// inside that epoch anymore.
+template <typename T>
+class RetireList {
+ public:
+  /// Retires an item.
+  /// @param[in] item  The item, it must no longer be reachable for new readers.
+  /// @param[in] epoch The current epoch.
+  void retire(T item, uint64_t epoch) {
+    items.emplace_back(std::move(item), epoch);
+  }
+
+  /// Hands the items that were retired before an epoch to a function.
+  /// @param[in] safe_epoch The oldest epoch that a reader is inside of.
+  /// @param[in] fn         Called with every item that can be reused.
+  template <typename FnT>
+  void reclaim(uint64_t safe_epoch, FnT&& fn) {
+    size_t kept = 0;
+    for (size_t i = 0; i < items.size(); ++i) {
+      if (items[i].second < safe_epoch) {
+        fn(std::move(items[i].first));
+      } else {
+        // Items that own memory must not be moved onto themselves.
+        if (kept != i) items[kept] = std::move(items[i]);
+        ++kept;
+      }
+    }
+    items.resize(kept);
+  }
+
+  /// Returns the number of items that wait for reclamation.
+  size_t size() const { return items.size(); }
+
+  /// Are there no items that wait for reclamation?
+  bool empty() const { return items.empty(); }
+
+ private:
+  /// The items with the epoch they were retired in.
+  std::vector<std::pair<T, uint64_t>> items;
+};
+
+}  // namespace buzzdb
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace buzzdb {
+
+/// A fixed set of worker threads that run submitted tasks.
+class ThreadPool {
+ public:
+  /// Constructor.
+  /// @param[in] thread_count The number of worker threads, at least one.
+  explicit ThreadPool(size_t thread_count) {
+    if (thread_count == 0) thread_count = 1;
+    for (size_t i = 0; i < thread_count; ++i) {
+      workers.emplace_back([this] { work(); });
+    }
+  }
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  /// Destructor.
+  /// Runs the remaining tasks and joins the workers.
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> guard(mutex);
+      stopping = true;
+    }
+    task_available.notify_all();
+    for (auto& worker : workers) {
+      worker.join();
+    }
+  }
+
+  /// Returns the number of worker threads.
+  size_t size() const { return workers.size(); }
+
+  /// Schedules a task on one of the workers.
+  void submit(std::function<void()> task) {
+    {
+      std::lock_guard<std::mutex> guard(mutex);
+      tasks.push(std::move(task));
+      ++pending;
+    }
+    task_available.notify_one();
+  }
+
+  /// Waits until all submitted tasks have finished.
+  /// Rethrows the first exception that was thrown by one of the tasks.
+  void wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    all_done.wait(lock, [this] { return pending == 0; });
+    if (error) {
+      std::exception_ptr task_error = error;
+      error = nullptr;
+      std::rethrow_exception(task_error);
+    }
+  }
+
+ private:
+  /// The loop of a worker thread.
+  void work() {
+    while (true) {
+      std::function<void()> task;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        task_available.wait(lock,
+                            [this] { return stopping || !tasks.empty(); });
+        if (tasks.empty()) return;
+        task = std::move(tasks.front());
+        tasks.pop();
+      }
+      std::exception_ptr task_error;
+      try {
+        task();
+      } catch (...) {
+        task_error = std::current_exception();
+      }
+      std::lock_guard<std::mutex> guard(mutex);
+      if (task_error && !error) error = task_error;
+      if (--pending == 0) all_done.notify_all();
+    }
+  }
+
+  /// Protects all members below.
+  std::mutex mutex;
+  /// Signaled when a task was submitted or the pool is stopping.
+  std::condition_variable task_available;
+  /// Signaled when the last pending task finished.
+  std::condition_variable all_done;
+  /// The tasks that have not been started yet.
+  std::queue<std::function<void()>> tasks;
+  /// The number of submitted tasks that have not finished yet.
+  size_t pending = 0;
+  /// The first exception thrown by a task since the last `wait()`.
+  std::exception_ptr error;
+  /// Is the pool being destroyed?
+  bool stopping = false;
+  /// The worker threads.
+  std::vector<std::thread> workers;
+};
+
+}  // namespace buzzdb
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace buzzdb {
+
+/// A blocked Bloom filter over key hashes.
+/// All bits of a key are set in one block of the size of a cache line, so a
+/// query touches a single cache line. There are no false negatives, the rate
+/// of false positives grows when more keys than planned are inserted.
+class BlockedBloomFilter {
+    public:
+    /// The number of bits that are set per key.
+    static constexpr uint32_t kHashes = 6;
+
+    /// Constructor.
+    /// @param[in] keys         The number of keys the filter is sized for.
+    /// @param[in] bits_per_key The number of bits per planned key.
+    BlockedBloomFilter(size_t keys, size_t bits_per_key)
+        : keys(keys), blocks((keys * bits_per_key + kBlockBits - 1) / kBlockBits + 1) {}
+
+    /// Adds a key.
+    /// @param[in] hash     The hash of the key, see `key_hash()`.
+    void insert(uint64_t hash) {
+        hash = mix(hash);
+        auto& block = blocks[block_of(hash)];
+        uint64_t bits = mix(hash);
+        for (uint32_t i = 0; i < kHashes; ++i) {
+            uint32_t bit = (bits >> (i * 9)) & (kBlockBits - 1);
+            block.words[bit / 64] |= 1ull << (bit % 64);
+        }
+    }
+
+    /// Was the key possibly added?
+    /// @param[in] hash     The hash of the key, see `key_hash()`.
+    bool may_contain(uint64_t hash) const {
+        hash = mix(hash);
+        const auto& block = blocks[block_of(hash)];
+        uint64_t bits = mix(hash);
+        bool contained = true;
+        for (uint32_t i = 0; i < kHashes; ++i) {
+            uint32_t bit = (bits >> (i * 9)) & (kBlockBits - 1);
+            contained &= (block.words[bit / 64] >> (bit % 64)) & 1;
+        }
+        return contained;
+    }
+
+    /// Returns the number of keys the filter was sized for.
+    size_t capacity() const { return keys; }
+
+    protected:
+    /// The number of bits of a block.
+    static constexpr uint32_t kBlockBits = 512;
+
+    /// A block of one cache line.
+    struct alignas(64) Block {
+        uint64_t words[kBlockBits / 64] = {};
+    };
+
+    /// Spreads the entropy of a hash over all bits (the finalizer of SplitMix64).
+    static uint64_t mix(uint64_t hash) {
+        hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ull;
+        hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebull;
+        return hash ^ (hash >> 31);
+    }
+
+    /// Maps a mixed hash to a block without a division.
+    size_t block_of(uint64_t hash) const {
+        return static_cast<size_t>((static_cast<unsigned __int128>(hash) * blocks.size()) >> 64);
+    }
+
+    /// The number of keys the filter was sized for.
+    size_t keys;
+    /// The blocks.
+    std::vector<Block> blocks;
+};
+
+}  // namespace buzzdb
@@ -1,22 +1,53 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
 #include <cstddef>
 #include <cstring>
 #include <functional>
 #include <iostream>
+#include <memory>
 #include <optional>
+#include <set>
+#include <utility>
+#include <vector>
 
 #include "buffer/buffer_manager.h"
 #include "common/defer.h"
+#include "common/epoch.h"
 #include "common/macros.h"
+#include "common/thread_pool.h"
+#include "index/bloom_filter.h"
+#include "index/inner_layout.h"
+#include "index/leaf_layout.h"
+#include "index/lookup_cache.h"
+#include "index/node_storage.h"
+#include "index/scan_filter.h"
+#include "index/search.h"
 #include "storage/segment.h"
 
 #define UNUSED(p)  ((void)(p))
 
 namespace buzzdb {
 
-template<typename KeyT, typename ValueT, typename ComparatorT, size_t PageSize>
+/// @tparam SearchPolicyT   How the sorted keys of a node are searched, see
+///                         `index/search.h`.
+/// @tparam InnerLayoutT    How the separators of the inner nodes are laid out
+///                         for searching, see `index/inner_layout.h`.
+/// @tparam LeafLayoutT     How the entries of the leaf nodes are laid out, see
+///                         `index/leaf_layout.h`.
+/// @tparam StoragePolicyT  Where the nodes live, see `index/node_storage.h`.
+template<typename KeyT, typename ValueT, typename ComparatorT, size_t PageSize,
+         typename SearchPolicyT = BinarySearch,
+         typename InnerLayoutT = SortedInnerLayout,
+         typename LeafLayoutT = SoALeafLayout,
+         typename StoragePolicyT = BufferManagerStorage>
 struct BTree : public Segment {
+    /// The pages of the nodes.
+    using Pages = typename StoragePolicyT::template Pages<PageSize>;
+    /// The frame of a fixed page.
+    using Frame = typename Pages::Frame;
+
     struct Node {
 
         /// The level in the tree.
@@ -44,35 +75,41 @@ struct BTree : public Segment {
         /// The children.
         uint64_t children[kCapacity];
 
+        /// The search index over the separators.
+        typename InnerLayoutT::template Index<KeyT, kCapacity> key_index;
+
         /// Constructor.
         InnerNode() : Node(0, 0) {}
 
 
-        /// Get the index of the first key that is not less than the provided key.
+        /// Get the index of the first separator that is not less than the provided key.
+        /// Only the `count - 1` separators are searched, if the key is larger than all
+        /// of them the second component is false and the last child is responsible.
         /// @param[in] key       The key to be checked against.
-        std::pair<uint32_t, bool> lower_bound(const KeyT &key) {
-            if (this->count == 0) {
-                return {0, false};
-            }
-            uint32_t start = 0;
-            uint32_t end = this->count - 1;
-            while (start <= end) {
-                uint32_t center = start + (end - start) / 2;
+        std::pair<uint32_t, bool> lower_bound(const KeyT &key) const {
+            uint32_t idx = key_index.template lower_bound<SearchPolicyT>(keys, separator_count(), key);
+            return {idx, idx < separator_count()};
+        }
 
-                if (keys[center] == key) {
-                    return {center, true};
-                }
-                if (keys[center] < key) {
-                    start = center + 1;
-                } else {
-                    if (center == 0 || keys[center - 1] < key) {
-                        return {center, true};
-                    }
-                    end = center - 1;
-                }
-            }
+        /// Get the slot of the child that is responsible for a key.
+        /// @param[in] key       The key to be checked against.
+        uint32_t child_slot(const KeyT &key) const {
+            auto [idx, found] = lower_bound(key);
+            return found ? idx : this->count - 1;
+        }
+
+        /// Returns the number of separators.
+        uint32_t separator_count() const { return this->count > 0 ? this->count - 1 : 0; }
+
+        /// Rebuilds the search index after the separators were changed.
+        /// Must be called while the node is fixed exclusively, searches never
+        /// write to the node.
+        void update_index() { key_index.rebuild(keys, separator_count()); }
 
-            return {this->count, false};
+        /// Returns the page id of a child, whether its reference is swizzled or not.
+        /// @param[in] slot      The slot of the child.
+        uint64_t child_id(uint32_t slot) const {
+            return Pages::page_id_of(children[slot]);
         }
 
 
@@ -86,6 +123,7 @@ struct BTree : public Segment {
 
             if (this->count == 1) {
                 childVec.push_back(split_page);
+                keyVec.assign(1, key);
             } else {
                 if (keyExists){
                     auto keyTemp = keys[insertPos];
@@ -104,6 +142,7 @@ struct BTree : public Segment {
             this->count++;
             std::copy(childVec.begin(), childVec.end(), children);
             std::copy(keyVec.begin(), keyVec.end(), keys);
+            update_index();
         }
 
 
@@ -120,6 +159,8 @@ struct BTree : public Segment {
             memcpy(right_inner_node->children, &children[split_point], tempNum * sizeof(uint64_t));
             memcpy(right_inner_node->keys, &keys[split_point], tempNum * sizeof(KeyT));
             this->count = split_point;
+            update_index();
+            right_inner_node->update_index();
             return split_key;
         }
 
@@ -145,38 +186,33 @@ struct BTree : public Segment {
         /// TODO think about the capacity that the nodes have.
         static constexpr uint32_t kCapacity = 42;
 
-        /// The keys.
-        KeyT keys[kCapacity];
-        /// The values.
-        ValueT values[kCapacity];
+        /// Incremented whenever entries are added, removed or moved, see `Cursor`.
+        uint32_t version = 0;
+
+        /// The keys and values, laid out as defined by the leaf layout.
+        typename LeafLayoutT::template Storage<KeyT, ValueT, kCapacity> slots;
 
         /// Constructor.
         LeafNode() : Node(0, 0) {}
 
+        /// Returns the key in a slot.
+        const KeyT& key_at(uint32_t slot) const { return slots.key(slot); }
 
+        /// Returns the value in a slot.
+        ValueT& value_at(uint32_t slot) { return slots.value(slot); }
 
-        std::pair<uint32_t, bool> lower_bound(const KeyT &key) {
-            if (this->count == 0) {
-                return {0, false};
-            }
-            uint32_t start = 0;
-            uint32_t end = this->count - 1;
-            while (start <= end) {
-                uint32_t center = start + (end - start) / 2;
+        /// Get the index of the first key that is not less than the provided key.
+        /// @param[in] key       The key to be checked against.
+        std::pair<uint32_t, bool> lower_bound(const KeyT &key) const {
+            uint32_t idx = slots.template lower_bound<SearchPolicyT>(this->count, key);
+            return {idx, idx < this->count};
+        }
 
-                if (keys[center] == key) {
-                    return {center, true};
-                }
-                if (keys[center] < key) {
-                    start = center + 1;
-                } else {
-                    if (center == 0 || keys[center - 1] < key) {
-                        return {center, true};
-                    }
-                    end = center - 1;
-                }
-            }
-            return {this->count, false};
+        /// Get the slot of a key.
+        /// @param[in] key       The key that should be searched.
+        /// @return              The slot, or `count` if the key is not in the leaf.
+        uint32_t find(const KeyT &key) const {
+            return slots.template find<SearchPolicyT>(this->count, key);
         }
 
         /// Insert a key.
@@ -184,28 +220,14 @@ struct BTree : public Segment {
         /// @param[in] value        The value that should be inserted.
         void insert(const KeyT &key, const ValueT &value) {
             auto [insertPos, keyExists] = this->lower_bound(key);
-            std::vector<uint64_t> valueVec = get_value_vector();
-            std::vector<KeyT> keyVec = get_key_vector();
-            if (keyExists && key >= keys[insertPos]) {
-                valueVec[insertPos] = value;
-            } else {
-                if (keyExists) {
-                    keyVec.insert(keyVec.begin() + insertPos, key);
-                    valueVec.insert(valueVec.begin() + insertPos, value);
-                } else {
-                    keyVec.push_back(key);
-                    valueVec.push_back(value);
-                }
-                this->count++;
-            }
-            syncArrays(keyVec, valueVec);
-        }
-
-        void syncArrays(const std::vector<KeyT>& keyVec, const std::vector<ValueT>& valueVec) {
-            for (size_t i = 0; i < this->count; i++) {
-                keys[i] = keyVec[i];
-                values[i] = valueVec[i];
+            if (keyExists && key_at(insertPos) == key) {
+                slots.set(insertPos, key, value);
+                return;
             }
+            slots.move(insertPos + 1, insertPos, this->count - insertPos);
+            slots.set(insertPos, key, value);
+            this->count++;
+            ++version;
         }
 
         /// Erase a key.
@@ -219,78 +241,533 @@ struct BTree : public Segment {
         }
 
         bool locateKeyPosition(const KeyT &keyToLocate, uint32_t &position) {
-            auto searchResult = this->lower_bound(keyToLocate);
-            position = searchResult.second ? searchResult.first : this->count - 1;
-            return searchResult.second && (keys[position] == keyToLocate);
+            position = find(keyToLocate);
+            return position < this->count;
         }
 
         void moveDataToLeftFrom(uint32_t startIndex) {
-            std::memmove(keys + startIndex, keys + startIndex + 1, (this->count - startIndex) * sizeof(KeyT));
-            std::memmove(values + startIndex, values + startIndex + 1, (this->count - startIndex) * sizeof(ValueT));
+            slots.move(startIndex, startIndex + 1, this->count - startIndex - 1);
             --this->count;
+            ++version;
+        }
+
+        /// Erase all keys in [lo, hi].
+        void erase_range(const KeyT &lo, const KeyT &hi) {
+            uint32_t begin = lower_bound(lo).first;
+            uint32_t end = lower_bound(hi).first;
+            if (end < this->count && key_at(end) == hi) {
+                ++end;
+            }
+            if (begin < end) {
+                slots.move(begin, end, this->count - end);
+                this->count -= end - begin;
+                ++version;
+            }
         }
 
         /// Split the node.
+        /// The left node keeps the larger half, its last key is the separator.
         /// @param[in] buffer       The buffer for the new page.
         /// @return                 The separator key.
         KeyT split(std::byte* buffer) {
-            int halfPoint = (this->count - 1) / 2;
-            LeafNode* newLeaf = createAndInitializeLeaf(buffer, halfPoint);
-            
-            KeyT separatorKey = keys[halfPoint + 1];
-
-            transferDataToNewLeaf(halfPoint, newLeaf);
-
-            return separatorKey;
-        }
-
-        LeafNode* createAndInitializeLeaf(std::byte* buffer, int half) {
-            LeafNode* leaf = reinterpret_cast<LeafNode*>(buffer);
-            leaf->count = half;
-            this->count -= half;
-            return leaf;
-        }
-
-        void transferDataToNewLeaf(int startPoint, LeafNode* leaf) {
-            std::copy(values + this->count, values + this->count + startPoint + 1, leaf->values);
-            std::copy(keys + this->count, keys + this->count + startPoint, leaf->keys);
+            auto* newLeaf = new (buffer) LeafNode();
+            uint32_t rightCount = (this->count - 1) / 2;
+            uint32_t leftCount = this->count - rightCount;
+            slots.copy_to(newLeaf->slots, 0, leftCount, rightCount);
+            newLeaf->count = rightCount;
+            this->count = leftCount;
+            ++version;
+            return key_at(leftCount - 1);
         }
 
         // Returns the keys.
         /// Can be implemented inefficiently as it's only used in the tests.
         std::vector<KeyT> get_key_vector() {
-            return std::vector<KeyT>(std::begin(keys), std::begin(keys) + this->count);
+            std::vector<KeyT> keyVec;
+            for (uint32_t i = 0; i < this->count; ++i) {
+                keyVec.push_back(key_at(i));
+            }
+            return keyVec;
         }
         
 
         /// Returns the values.
         std::vector<ValueT> get_value_vector() {
-            return std::vector<KeyT>(std::begin(values), std::begin(values) + this->count);
+            std::vector<ValueT> valueVec;
+            for (uint32_t i = 0; i < this->count; ++i) {
+                valueVec.push_back(value_at(i));
+            }
+            return valueVec;
         }
     };
 
+    static_assert(sizeof(InnerNode) <= PageSize, "inner nodes must fit into a page");
+    static_assert(sizeof(LeafNode) <= PageSize, "leaf nodes must fit into a page");
+
+    /// The pages of the nodes.
+    Pages pages;
+
     /// The root.
     std::optional<uint64_t> root;
 
-    /// Next page id.
-    /// You don't need to worry about about the page allocation.
-    /// Just increment the next_page_id whenever you need a new page.
+    /// Next page id within the segment.
+    /// Pages are allocated with `allocate_page()`.
     uint64_t next_page_id;
 
+    /// Pages that were freed and can be allocated again.
+    std::vector<uint64_t> free_pages;
+
+    /// Pages that were freed while readers could still access them, they are
+    /// moved to `free_pages` by `reclaim_pages()`.
+    RetireList<uint64_t> pending_pages;
+
+    /// The version of the pages that are allocated now, `snapshot()` starts a new one.
+    uint32_t write_version = 0;
+
+    /// The version at which every page of the segment was allocated.
+    std::vector<uint32_t> page_versions;
+
+    /// The versions of the snapshots that are alive.
+    std::multiset<uint32_t> snapshot_versions;
+
+    /// Pages that were replaced or unlinked while snapshots could still read them,
+    /// together with the write version at that time.
+    std::vector<std::pair<uint64_t, uint32_t>> retired_pages;
+
+    /// Incremented whenever a page is freed or leaves are rewritten in bulk.
+    /// While it does not change, a page id that referred to a leaf still does.
+    uint64_t structure_version = 0;
+
+    /// The filter that answers lookups of missing keys without a descent, if enabled.
+    /// It holds the keys of all inserts since it was built, erased keys stay in it
+    /// until it is rebuilt.
+    std::optional<BlockedBloomFilter> key_filter;
+    /// The bits per key of the key filter.
+    size_t key_filter_bits_per_key = 0;
+    /// The number of keys that were added to the key filter since it was built.
+    size_t key_filter_inserts = 0;
+    /// The number of erases since the key filter was built.
+    size_t key_filter_erases = 0;
+
+    /// The cache of hot keys in front of `lookup()`, if enabled.
+    std::unique_ptr<LookupCache<KeyT, ValueT>> lookup_cache;
+
+    /// The storage of the leaves.
+    using LeafStorage = decltype(LeafNode::slots);
+    /// Do the leaves adapt to their point lookups, see `AdaptiveLeafLayout`?
+    static constexpr bool kAdaptiveLeaves = LeafStorage::kAdaptive;
+    /// The number of point lookup counters of adaptive leaves.
+    static constexpr size_t kLeafLookupCounters = 4096;
+
+    /// The point lookups of the adaptive leaves since their last modification.
+    /// They are kept outside of the pages, so that lookups do not write to the
+    /// leaves they share with other readers. Leaves are mapped to the counters by
+    /// address and may share one, which at worst builds a table too early.
+    std::unique_ptr<std::atomic<uint16_t>[]> leaf_lookups;
+
     /// Constructor.
     BTree(uint16_t segment_id, BufferManager &buffer_manager)
-        : Segment(segment_id, buffer_manager) {
-        next_page_id = 1;
+        : Segment(segment_id, buffer_manager), pages(segment_id, buffer_manager) {
+        next_page_id = 0;
+        if constexpr (kAdaptiveLeaves) {
+            leaf_lookups = std::make_unique<std::atomic<uint16_t>[]>(kLeafLookupCounters);
+        }
+        if constexpr (Pages::kSwizzling) {
+            buffer_manager.set_eviction_handler(segment_id, [this](BufferFrame &frame) {
+                return unswizzle_parent(frame);
+            });
+        }
+    }
+
+    BTree(const BTree&) = delete;
+    BTree& operator=(const BTree&) = delete;
+
+    /// Destructor.
+    ~BTree() {
+        if constexpr (Pages::kSwizzling) {
+            buffer_manager.set_eviction_handler(segment_id, {});
+        }
+    }
+
+    /// Returns the point lookup counter of an adaptive leaf.
+    std::atomic<uint16_t>& leaf_lookup_counter(const LeafNode &leaf) {
+        auto address = reinterpret_cast<uintptr_t>(&leaf) >> 6;
+        return leaf_lookups[(address * 0x9E3779B97F4A7C15ull) >> 52 & (kLeafLookupCounters - 1)];
+    }
+
+    /// Counts a point lookup of a leaf, if the leaves are adaptive.
+    /// @param[in] leaf     The leaf, fixed shared or exclusively.
+    void count_point_lookup(const LeafNode &leaf) {
+        if constexpr (kAdaptiveLeaves) {
+            auto& counter = leaf_lookup_counter(leaf);
+            if (counter.load(std::memory_order_relaxed) < LeafStorage::kHashThreshold) {
+                counter.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    /// Builds or drops the table of a modified leaf, if the leaves are adaptive.
+    /// @param[in] leaf     The leaf, fixed exclusively.
+    void adapt_leaf(LeafNode &leaf) {
+        if constexpr (kAdaptiveLeaves) {
+            leaf.slots.adapt(leaf.count, leaf_lookup_counter(leaf).exchange(0, std::memory_order_relaxed));
+        }
+    }
+
+    /// Replaces the swizzled reference to a frame that is about to be evicted
+    /// by the page id. The parent is found by descending with a key of the node.
+    /// Inner nodes with swizzled children are not evicted, so the path to every
+    /// swizzled reference stays in memory. The buffer manager keeps the frame
+    /// from being fixed meanwhile, so its node does not change.
+    /// @param[in] frame    The frame that is about to be evicted.
+    /// @return             Whether the frame may be evicted.
+    bool unswizzle_parent(BufferFrame &frame) {
+        uint64_t pageID = frame.get_page_id();
+        auto* node = reinterpret_cast<Node*>(frame.get_data());
+        if (!node->is_leaf()) {
+            auto* inner = reinterpret_cast<InnerNode*>(node);
+            for (uint32_t i = 0; i < inner->count; ++i) {
+                if (Pages::is_swizzled(inner->children[i])) return false;
+            }
+        }
+        if (!root || root.value() == pageID) return true;
+
+        KeyT key;
+        if (node->is_leaf()) {
+            auto* leaf = reinterpret_cast<LeafNode*>(node);
+            // An empty leaf cannot be located by a key.
+            if (leaf->count == 0) return false;
+            key = leaf->key_at(0);
+        } else {
+            auto* inner = reinterpret_cast<InnerNode*>(node);
+            if (inner->count < 2) return false;
+            key = inner->keys[0];
+        }
+
+        uint64_t current = root.value();
+        while (true) {
+            auto& parentFrame = pages.fix_page(current, true);
+            auto* parent = reinterpret_cast<InnerNode*>(parentFrame.get_data());
+            if (parent->level <= node->level) {
+                // The node is no longer part of the tree.
+                pages.unfix_page(parentFrame, false);
+                return true;
+            }
+            uint32_t slot = parent->child_slot(key);
+            if (parent->level == node->level + 1) {
+                // Readers swizzle references while the parent is fixed shared.
+                uint64_t expected = Pages::swizzled(frame);
+                bool isSwizzled = __atomic_compare_exchange_n(&parent->children[slot], &expected, pageID, false,
+                                                              __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+                pages.unfix_page(parentFrame, isSwizzled);
+                return true;
+            }
+            current = Pages::page_id_of(__atomic_load_n(&parent->children[slot], __ATOMIC_ACQUIRE));
+            pages.unfix_page(parentFrame, false);
+        }
+    }
+
+    /// Replaces all swizzled references in the inner nodes by page ids.
+    /// @param[in] pageID   The root of the subtree.
+    void unswizzle_all(uint64_t pageID) {
+        auto& frame = pages.fix_page(pageID, true);
+        auto* node = reinterpret_cast<Node*>(frame.get_data());
+        bool isDirty = false;
+        if (!node->is_leaf()) {
+            auto* inner = reinterpret_cast<InnerNode*>(node);
+            for (uint32_t i = 0; i < inner->count; ++i) {
+                if (Pages::is_swizzled(inner->children[i])) {
+                    inner->children[i] = inner->child_id(i);
+                    isDirty = true;
+                }
+                if (inner->level > 1) unswizzle_all(inner->children[i]);
+            }
+        }
+        pages.unfix_page(frame, isDirty);
+    }
+
+    /// Allocates a new page in the segment of the tree.
+    /// Freed pages are reused first, the content of the page is undefined.
+    /// @return             The overall page id of the new page.
+    uint64_t allocate_page() {
+        if (free_pages.empty() && !pending_pages.empty()) {
+            reclaim_pages();
+        }
+        uint64_t page_id;
+        if (!free_pages.empty()) {
+            page_id = free_pages.back();
+            free_pages.pop_back();
+        } else {
+            page_id = BufferManager::get_overall_page_id(segment_id, next_page_id++);
+        }
+        uint64_t local = BufferManager::get_segment_page_id(page_id);
+        if (page_versions.size() <= local) {
+            page_versions.resize(local + 1, 0);
+        }
+        page_versions[local] = write_version;
+        return page_id;
+    }
+
+    /// Returns a page that is no longer referenced by the tree to the allocator.
+    /// Pages that snapshots can still read are retired until the snapshots are gone,
+    /// other pages are reused once the readers of the current epoch have exited.
+    /// @param[in] page_id  The overall page id of the page.
+    void free_page(uint64_t page_id) {
+        ++structure_version;
+        if (is_frozen(page_id)) {
+            retired_pages.emplace_back(page_id, write_version);
+        } else {
+            pending_pages.retire(page_id, buffer_manager.get_epoch_manager().current());
+        }
+    }
+
+    /// Starts a new epoch and moves the pending pages that no reader can access
+    /// anymore to the free pages.
+    void reclaim_pages() {
+        auto& epochs = buffer_manager.get_epoch_manager();
+        epochs.advance();
+        pending_pages.reclaim(epochs.oldest_active(), [&](uint64_t page_id) {
+            free_pages.push_back(page_id);
+        });
+    }
+
+    /// Can a snapshot read the page?
+    /// Such pages must not be modified, see `make_writable()`.
+    bool is_frozen(uint64_t page_id) const {
+        if (snapshot_versions.empty()) return false;
+        uint64_t local = BufferManager::get_segment_page_id(page_id);
+        uint32_t version = local < page_versions.size() ? page_versions[local] : 0;
+        return version <= *snapshot_versions.rbegin();
+    }
+
+    /// Returns a page with the content of a page that can be modified.
+    /// A frozen page is copied to a new page and retired, the caller has to
+    /// replace its reference to the page by the returned page id.
+    /// @param[in] page_id  The overall page id of the page.
+    /// @return             The page id of the modifiable page.
+    uint64_t make_writable(uint64_t page_id) {
+        if (!is_frozen(page_id)) return page_id;
+        uint64_t copy_id = allocate_page();
+        auto& frame = pages.fix_page(page_id, false);
+        auto& copy = pages.fix_page(copy_id, true);
+        std::memcpy(copy.get_data(), frame.get_data(), PageSize);
+        pages.unfix_page(copy, true);
+        pages.unfix_page(frame, false);
+        free_page(page_id);
+        return copy_id;
+    }
+
+    /// A read-only view of the tree as it was when the snapshot was taken.
+    /// Writers copy a page on its first modification after a snapshot was taken
+    /// instead of overwriting it (path copying from the root), so the pages that
+    /// are reachable from the root of the snapshot never change. Lookups and scans
+    /// on a snapshot may run concurrently with writes to the tree, because they
+    /// only search the shared pages and searches of the leaf and inner layouts
+    /// must not write to a page (the searches of `LeafNode` are const, so a
+    /// layout that writes does not compile). Taking and destroying snapshots has
+    /// to be serialized with the writes.
+    struct Snapshot {
+        /// The tree, nullptr if the snapshot was moved away.
+        BTree* tree;
+        /// The root of the tree when the snapshot was taken.
+        std::optional<uint64_t> root;
+        /// The version of the snapshot.
+        uint32_t version;
+
+        /// Constructor.
+        Snapshot(BTree &tree, std::optional<uint64_t> root, uint32_t version)
+            : tree(&tree), root(root), version(version) {}
+
+        Snapshot(const Snapshot&) = delete;
+        Snapshot& operator=(const Snapshot&) = delete;
+
+        Snapshot(Snapshot &&other) noexcept
+            : tree(other.tree), root(other.root), version(other.version) {
+            other.tree = nullptr;
+        }
+
+        /// Destructor.
+        /// The pages that only the snapshot could read are freed.
+        ~Snapshot() {
+            if (tree) tree->release_snapshot(version);
+        }
+
+        /// Lookup an entry in the snapshot.
+        /// @param[in] key      The key that should be searched.
+        std::optional<ValueT> lookup(const KeyT &key) const {
+            return tree->lookup_from(root, key);
+        }
+
+        /// Scans all entries of the snapshot with keys in [lo, hi], see `BTree::scan()`.
+        template<typename ConsumerT>
+        void scan(const KeyT &lo, const KeyT &hi, ConsumerT &&consumer) const {
+            tree->scan_from(root, lo, hi, NoFilter{}, consumer);
+        }
+    };
+
+    /// Takes a snapshot of the tree.
+    /// Until the snapshot is destroyed, all pages of the tree are frozen.
+    Snapshot snapshot() {
+        // Snapshots share pages with the tree, they must not hold swizzled
+        // references that an eviction could invalidate.
+        if constexpr (Pages::kSwizzling) {
+            if (root) unswizzle_all(root.value());
+        }
+        uint32_t version = write_version++;
+        snapshot_versions.insert(version);
+        return Snapshot(*this, root, version);
+    }
+
+    /// Forgets a snapshot and frees the retired pages that no snapshot can read anymore.
+    /// A page retired at write version `v` can be read by the snapshots older than `v`.
+    void release_snapshot(uint32_t version) {
+        snapshot_versions.erase(snapshot_versions.find(version));
+        uint32_t oldest = snapshot_versions.empty() ? write_version : *snapshot_versions.begin();
+        size_t kept = 0;
+        auto epoch = buffer_manager.get_epoch_manager().current();
+        for (auto& retired : retired_pages) {
+            if (retired.second <= oldest) {
+                pending_pages.retire(retired.first, epoch);
+            } else {
+                retired_pages[kept++] = retired;
+            }
+        }
+        retired_pages.resize(kept);
+        reclaim_pages();
+    }
+
+    /// The smallest number of keys a key filter is sized for.
+    static constexpr size_t kMinKeyFilterKeys = 1024;
+
+    /// Puts a Bloom filter over all keys in front of `lookup()`.
+    /// Lookups of most missing keys then cost one cache line instead of a
+    /// descent that fixes a page per level. The filter is rebuilt from the
+    /// leaves when more keys were inserted than it was sized for, or when half
+    /// of its keys may have been erased. Snapshots are not filtered.
+    /// @param[in] bits_per_key The size of the filter, 10 bits per key give
+    ///                         about one percent false positives.
+    void enable_key_filter(size_t bits_per_key = 10) {
+        key_filter_bits_per_key = bits_per_key;
+        rebuild_key_filter();
+    }
+
+    /// Removes the key filter.
+    void disable_key_filter() {
+        key_filter.reset();
+        key_filter_bits_per_key = 0;
+    }
+
+    /// Builds the key filter from the keys in the leaves.
+    /// Twice the current number of keys is planned for, so the filter is not
+    /// rebuilt again right away while the tree grows.
+    void rebuild_key_filter() {
+        std::vector<uint64_t> hashes;
+        scan_all_leaves([&](LeafNode &leaf, uint32_t) {
+            for (uint32_t slot = 0; slot < leaf.count; ++slot) {
+                hashes.push_back(key_hash(leaf.key_at(slot)));
+            }
+            return true;
+        });
+        key_filter.emplace(std::max(2 * hashes.size(), kMinKeyFilterKeys), key_filter_bits_per_key);
+        for (uint64_t hash : hashes) {
+            key_filter->insert(hash);
+        }
+        key_filter_inserts = hashes.size();
+        key_filter_erases = 0;
+    }
+
+    /// Adds a key to the key filter, if there is one.
+    void add_to_key_filter(const KeyT &key) {
+        if (!key_filter) return;
+        if (++key_filter_inserts > key_filter->capacity()) {
+            // Rebuilt after the key is in the leaves.
+            key_filter.reset();
+            return;
+        }
+        key_filter->insert(key_hash(key));
     }
 
+    /// Rebuilds the key filter if it was reset by `add_to_key_filter()` or if
+    /// too many of its keys may have been erased.
+    /// @param[in] force    Rebuild it in any case, after the leaves were replaced.
+    void refresh_key_filter(bool force = false) {
+        if (key_filter_bits_per_key == 0) return;
+        if (force || !key_filter || key_filter_erases > key_filter->capacity() / 2) {
+            rebuild_key_filter();
+        }
+    }
+
+
+    /// Puts a cache of hot keys in front of `lookup()`.
+    /// A cached key is found with one hash probe instead of a descent. Found
+    /// keys are admitted by lookups, writes update or remove cached keys, so the
+    /// cache never returns stale values. Lookups may run concurrently with each
+    /// other but, as without the cache, not with writes. Snapshots are not cached.
+    /// @param[in] capacity The maximum number of cached keys.
+    void enable_lookup_cache(size_t capacity) {
+        lookup_cache = std::make_unique<LookupCache<KeyT, ValueT>>(capacity);
+    }
+
+    /// Removes the lookup cache.
+    void disable_lookup_cache() {
+        lookup_cache.reset();
+    }
 
     /// Lookup an entry in the tree.
     /// @param[in] key      The key that should be searched.
     /// @return             Whether the key was in the tree.
     std::optional<ValueT> lookup(const KeyT &key) {
-        if (!root) return {};
+        if (lookup_cache) {
+            if (auto cached = lookup_cache->find(key)) return cached;
+        }
+        if (key_filter && !key_filter->may_contain(key_hash(key))) return {};
+        auto result = lookup_from(root, key, snapshot_versions.empty());
+        if (lookup_cache && result) lookup_cache->admit(key, *result);
+        return result;
+    }
+
+    /// Do readers fix the nodes they read? Readers are inside an epoch, which
+    /// keeps the frames they read from being freed (see
+    /// `BufferManager::read_page()`), so they skip the pin of every node.
+    /// Readers that swizzle references write to the parent and fix it.
+    static constexpr bool kPinnedReads = Pages::kSwizzling;
+
+    /// Returns the frame of a node for a reader inside an epoch.
+    /// It is released with `release_node()`.
+    Frame& read_node(uint64_t page_id) {
+        if constexpr (kPinnedReads) {
+            return pages.fix_page(page_id, false);
+        } else {
+            return pages.read_page(page_id);
+        }
+    }
+
+    /// Returns the frame of a child for a reader inside an epoch, see `read_node()`.
+    /// @param[in] inner    The parent.
+    /// @param[in] slot     The slot of the child.
+    /// @param[in] swizzle  Should the reference be swizzled?
+    Frame& read_child(InnerNode &inner, uint32_t slot, bool swizzle) {
+        if constexpr (kPinnedReads) {
+            if (swizzle) return pages.fix_child(inner.children[slot], false);
+        }
+        return read_node(inner.child_id(slot));
+    }
+
+    /// Ends the access of a reader to a node that it got from `read_node()`.
+    void release_node(Frame &frame) {
+        if constexpr (kPinnedReads) pages.unfix_page(frame, false);
+    }
 
-        BufferFrame* currentFrame = &buffer_manager.fix_page(root.value(), false);
+    /// Lookup an entry in the tree with the provided root.
+    /// @param[in] start    The root.
+    /// @param[in] key      The key that should be searched.
+    /// @param[in] swizzle  Should the followed child references be swizzled?
+    ///                     Not while snapshots share the pages.
+    std::optional<ValueT> lookup_from(const std::optional<uint64_t> &start, const KeyT &key, bool swizzle = false) {
+        if (!start) return {};
+        auto guard = buffer_manager.get_epoch_manager().enter();
+
+        Frame* currentFrame = &read_node(start.value());
         Node* currentNode = reinterpret_cast<Node*>(currentFrame->get_data());
 
         while (!currentNode->is_leaf()) {
@@ -303,31 +780,490 @@ struct BTree : public Segment {
             if (!exactMatch) idx = currentNode->count - 1;
 
             // Lock coupling
-            uint64_t nextPageId = inner->children[idx];
-            BufferFrame* nextFrame = &buffer_manager.fix_page(nextPageId, false);
-            buffer_manager.unfix_page(*currentFrame, false);
+            Frame* nextFrame = &read_child(*inner, idx, swizzle);
+            release_node(*currentFrame);
             currentFrame = nextFrame;
             currentNode = reinterpret_cast<Node*>(currentFrame->get_data());
         }
 
         LeafNode* leaf = reinterpret_cast<LeafNode*>(currentNode);
-        auto [valueIdx, found] = leaf->lower_bound(key);
-        buffer_manager.unfix_page(*currentFrame, false);
+        uint32_t slot = leaf->find(key);
+        count_point_lookup(*leaf);
+        std::optional<ValueT> result;
+        if (slot < leaf->count) {
+            result = leaf->value_at(slot);
+        }
+        release_node(*currentFrame);
+        return result;
+    }
+
+    /// The number of cache lines of a node that are prefetched before it is searched.
+    static constexpr size_t kPrefetchLines = 8;
+
+    /// Prefetches the start of a node, where its header and the keys are.
+    static void prefetch_node(Frame &frame) {
+        const char* data = frame.get_data();
+        constexpr size_t lines = std::min(kPrefetchLines, (std::max(sizeof(InnerNode), sizeof(LeafNode)) + 63) / 64);
+        for (size_t line = 0; line < lines; ++line) {
+            __builtin_prefetch(data + line * 64);
+        }
+    }
+
+    /// A lookup of `lookup_interleaved()` that is in flight.
+    /// Every step searches one node whose cache lines were prefetched by the
+    /// previous step, fixes the child, prefetches it and suspends.
+    struct LookupState {
+        /// The position of the key in the input, `kIdle` if the state is unused.
+        size_t position;
+        /// The frame of the node that is searched next.
+        Frame* frame;
+    };
 
-        return (found && leaf->keys[valueIdx] == key) ? std::make_optional(leaf->values[valueIdx]) : std::nullopt;
+    /// The position of a `LookupState` that holds no lookup.
+    static constexpr size_t kIdle = ~size_t{0};
+
+    /// Looks up many independent keys with interleaved descents (AMAC).
+    /// Up to `group` lookups are in flight. The scheduler round-robins them,
+    /// each turn advances one lookup by one level and ends with a prefetch of
+    /// the next node, so the cache misses of the other lookups overlap with it.
+    /// A step that needs a page which is not in memory could suspend the same
+    /// way once fixing pages is asynchronous.
+    /// @param[in]  keys    The keys that should be searched.
+    /// @param[in]  count   The number of keys.
+    /// @param[out] out     The results, one per key.
+    /// @param[in]  group   The number of lookups in flight.
+    void lookup_interleaved(const KeyT *keys, size_t count, std::optional<ValueT> *out, size_t group = 8) {
+        if (!root) {
+            std::fill(out, out + count, std::nullopt);
+            return;
+        }
+        auto guard = buffer_manager.get_epoch_manager().enter();
+        bool swizzle = snapshot_versions.empty();
+        std::vector<LookupState> states(std::max<size_t>(std::min(group, count), 1), {kIdle, nullptr});
+        size_t next = 0;
+        // Starts the next lookup in a state, unless the keys are exhausted.
+        auto start = [&](LookupState &state) {
+            state.position = kIdle;
+            while (next < count) {
+                size_t position = next++;
+                if (key_filter && !key_filter->may_contain(key_hash(keys[position]))) {
+                    out[position].reset();
+                    continue;
+                }
+                state.position = position;
+                state.frame = &read_node(root.value());
+                prefetch_node(*state.frame);
+                return;
+            }
+        };
+        size_t active = 0;
+        for (auto& state : states) {
+            start(state);
+            active += state.position != kIdle;
+        }
+        while (active > 0) {
+            for (auto& state : states) {
+                if (state.position == kIdle) continue;
+                const KeyT& key = keys[state.position];
+                auto* node = reinterpret_cast<Node*>(state.frame->get_data());
+                if (node->is_leaf()) {
+                    auto* leaf = reinterpret_cast<LeafNode*>(node);
+                    uint32_t slot = leaf->find(key);
+                    count_point_lookup(*leaf);
+                    out[state.position] = slot < leaf->count ? std::optional<ValueT>(leaf->value_at(slot)) : std::nullopt;
+                    release_node(*state.frame);
+                    start(state);
+                    active -= state.position == kIdle;
+                    continue;
+                }
+                auto* inner = reinterpret_cast<InnerNode*>(node);
+                uint32_t slot = inner->child_slot(key);
+                Frame* child = &read_child(*inner, slot, swizzle);
+                prefetch_node(*child);
+                release_node(*state.frame);
+                state.frame = child;
+            }
+        }
+    }
+
+    /// Visits the leaves that may contain keys not less than `lo` in key order.
+    /// The ancestors of the current leaf stay in use, so no separators have to be
+    /// searched again when moving on to the next leaf. Must be called inside an
+    /// epoch, see `read_node()`.
+    /// @param[in] lo       The smallest key of interest.
+    /// @param[in] fn       Called with every leaf and the first slot with a key not
+    ///                     less than `lo`, returns whether the next leaf should be visited.
+    template<typename LeafFnT>
+    void scan_leaves(const KeyT &lo, LeafFnT &&fn) {
+        if (!root) return;
+        scan_leaves_in(root.value(), &lo, fn);
+    }
+
+    /// Visits all leaves in key order, see `scan_leaves()`.
+    template<typename LeafFnT>
+    void scan_all_leaves(LeafFnT &&fn) {
+        if (!root) return;
+        auto guard = buffer_manager.get_epoch_manager().enter();
+        scan_leaves_in(root.value(), nullptr, fn);
+    }
+
+    /// Visits the leaves of a subtree in key order, see `scan_leaves()`.
+    /// Must be called inside an epoch, the leaves are only read.
+    /// @param[in] lo       The smallest key of interest, or nullptr for the whole subtree.
+    /// @return             Whether the scan should continue.
+    template<typename LeafFnT>
+    bool scan_leaves_in(uint64_t pageID, const KeyT *lo, LeafFnT &fn) {
+        auto& frame = read_node(pageID);
+        auto* node = reinterpret_cast<Node*>(frame.get_data());
+        bool proceed = true;
+        if (node->is_leaf()) {
+            auto* leaf = reinterpret_cast<LeafNode*>(node);
+            proceed = fn(*leaf, lo ? leaf->lower_bound(*lo).first : 0u);
+        } else {
+            auto* inner = reinterpret_cast<InnerNode*>(node);
+            uint32_t first = lo ? inner->child_slot(*lo) : 0u;
+            for (uint32_t i = first; proceed && i < inner->count; ++i) {
+                proceed = scan_leaves_in(inner->child_id(i), i == first ? lo : nullptr, fn);
+            }
+        }
+        release_node(frame);
+        return proceed;
+    }
+
+    /// Scans the entries with keys in [lo, hi] that are accepted by a filter.
+    /// For leaves with separate key and value arrays, the filter is evaluated on
+    /// the arrays of a whole leaf at once and only the selected entries are emitted.
+    /// @param[in] lo       The smallest key of the range.
+    /// @param[in] hi       The largest key of the range.
+    /// @param[in] filter   The filter, see `index/scan_filter.h`.
+    /// @param[in] consumer Called with the key and value of every selected entry.
+    template<typename FilterT, typename ConsumerT>
+    void scan(const KeyT &lo, const KeyT &hi, const FilterT &filter, ConsumerT &&consumer) {
+        scan_from(root, lo, hi, filter, consumer);
+    }
+
+    /// Scans the tree with the provided root, see `scan()`.
+    template<typename FilterT, typename ConsumerT>
+    void scan_from(const std::optional<uint64_t> &start, const KeyT &lo, const KeyT &hi, const FilterT &filter,
+                   ConsumerT &consumer) {
+        if (!start || hi < lo) return;
+        auto guard = buffer_manager.get_epoch_manager().enter();
+        auto fn = [&](LeafNode &leaf, uint32_t begin) {
+            return scan_leaf(leaf, begin, hi, filter, consumer);
+        };
+        scan_leaves_in(start.value(), &lo, fn);
+    }
+
+    /// Scans the selected entries of one leaf, starting at slot `begin`, see `scan()`.
+    /// @return             Whether the range may continue in the next leaf.
+    template<typename FilterT, typename ConsumerT>
+    bool scan_leaf(LeafNode &leaf, uint32_t begin, const KeyT &hi, const FilterT &filter, ConsumerT &consumer) {
+        uint32_t end = leaf.lower_bound(hi).first;
+        if (end < leaf.count && leaf.key_at(end) == hi) {
+            ++end;
+        }
+        if constexpr (decltype(leaf.slots)::kColumnar) {
+            uint8_t matches[LeafNode::kCapacity];
+            uint32_t selection[LeafNode::kCapacity];
+            filter.evaluate(leaf.slots.keys + begin, leaf.slots.values + begin, end - begin, matches);
+            uint32_t selected = 0;
+            for (uint32_t i = begin; i < end; ++i) {
+                selection[selected] = i;
+                selected += matches[i - begin];
+            }
+            for (uint32_t i = 0; i < selected; ++i) {
+                consumer(leaf.key_at(selection[i]), leaf.value_at(selection[i]));
+            }
+        } else {
+            for (uint32_t i = begin; i < end; ++i) {
+                if (filter.matches(leaf.key_at(i), leaf.value_at(i))) {
+                    consumer(leaf.key_at(i), leaf.value_at(i));
+                }
+            }
+        }
+        return end == leaf.count;
+    }
+
+    /// Scans all entries with keys in [lo, hi].
+    /// @param[in] lo       The smallest key of the range.
+    /// @param[in] hi       The largest key of the range.
+    /// @param[in] consumer Called with the key and value of every entry.
+    template<typename ConsumerT>
+    void scan(const KeyT &lo, const KeyT &hi, ConsumerT &&consumer) {
+        scan(lo, hi, NoFilter{}, std::forward<ConsumerT>(consumer));
+    }
+
+    /// The number of subtrees that `parallel_scan()` aims for per partition.
+    /// More, smaller subtrees balance the partitions better.
+    static constexpr size_t kSubtreesPerPartition = 8;
+
+    /// Scans all entries with keys in [lo, hi] on a thread pool.
+    /// The separators of the top inner levels split the range into up to
+    /// `partitions` runs of adjacent subtrees of about the same size, every run
+    /// is scanned by one task. The tasks do not share any node, the nodes above
+    /// the subtrees are only read while partitioning. All keys of partition `p`
+    /// are less than the keys of partition `p + 1`. The tree must not be
+    /// modified during the scan.
+    /// @param[in] lo           The smallest key of the range.
+    /// @param[in] hi           The largest key of the range.
+    /// @param[in] pool         The thread pool, waits for all of its tasks.
+    /// @param[in] partitions   The maximum number of partitions.
+    /// @param[in] consumer     Called as `consumer(partition, key, value)`. The
+    ///                         entries of one partition are passed in key order
+    ///                         by one thread, different partitions run concurrently.
+    /// @return                 The number of partitions.
+    template<typename ConsumerT>
+    size_t parallel_scan(const KeyT &lo, const KeyT &hi, ThreadPool &pool, size_t partitions, ConsumerT &&consumer) {
+        if (!root || hi < lo || partitions == 0) return 0;
+        auto guard = buffer_manager.get_epoch_manager().enter();
+        std::vector<uint64_t> subtrees = partition_subtrees(lo, hi, partitions * kSubtreesPerPartition);
+        size_t used = std::min(partitions, subtrees.size());
+        for (size_t p = 0; p < used; ++p) {
+            size_t first = subtrees.size() * p / used;
+            size_t last = subtrees.size() * (p + 1) / used;
+            pool.submit([this, &lo, &hi, &subtrees, &consumer, p, first, last] {
+                auto workerGuard = buffer_manager.get_epoch_manager().enter();
+                auto emit = [&](const KeyT &key, ValueT &value) { consumer(p, key, value); };
+                auto fn = [&](LeafNode &leaf, uint32_t begin) {
+                    return scan_leaf(leaf, begin, hi, NoFilter{}, emit);
+                };
+                bool proceed = true;
+                for (size_t i = first; proceed && i < last; ++i) {
+                    // Only the first subtree can contain keys less than lo.
+                    proceed = scan_leaves_in(subtrees[i], i == 0 ? &lo : nullptr, fn);
+                }
+            });
+        }
+        pool.wait();
+        return used;
+    }
+
+    /// Collects the roots of the subtrees that cover [lo, hi] in key order.
+    /// Descends level by level until there are at least `count` subtrees or
+    /// the leaf level is reached.
+    std::vector<uint64_t> partition_subtrees(const KeyT &lo, const KeyT &hi, size_t count) {
+        std::vector<uint64_t> subtrees{root.value()};
+        while (subtrees.size() < count) {
+            std::vector<uint64_t> children;
+            for (size_t i = 0; i < subtrees.size(); ++i) {
+                auto& frame = read_node(subtrees[i]);
+                auto* node = reinterpret_cast<Node*>(frame.get_data());
+                if (node->is_leaf()) {
+                    release_node(frame);
+                    return subtrees;
+                }
+                auto* inner = reinterpret_cast<InnerNode*>(node);
+                uint32_t first = i == 0 ? inner->child_slot(lo) : 0u;
+                uint32_t last = i + 1 == subtrees.size() ? inner->child_slot(hi) : inner->count - 1u;
+                for (uint32_t slot = first; slot <= last; ++slot) {
+                    children.push_back(inner->child_id(slot));
+                }
+                release_node(frame);
+            }
+            subtrees = std::move(children);
+        }
+        return subtrees;
+    }
+
+    /// The result of `scan_batch()`.
+    struct ScanBatchResult {
+        /// The number of entries that were written to the output arrays.
+        size_t count;
+        /// Does the range contain more entries?
+        bool has_more;
+        /// The key to continue the scan with, if there are more entries.
+        KeyT resume_key;
+    };
+
+    /// Copies the entries with keys in [lo, hi] into caller-provided arrays.
+    /// The entries of a leaf are copied as contiguous runs. Pass `resume_key`
+    /// of the result as `lo` of the next call to continue the scan.
+    /// @param[in]  lo          The smallest key of the range.
+    /// @param[in]  hi          The largest key of the range.
+    /// @param[out] keys_out    The keys, must have room for `max` keys.
+    /// @param[out] values_out  The values, must have room for `max` values.
+    /// @param[in]  max         The maximum number of entries to produce.
+    ScanBatchResult scan_batch(const KeyT &lo, const KeyT &hi, KeyT *keys_out, ValueT *values_out, size_t max) {
+        ScanBatchResult result{0, false, KeyT{}};
+        if (hi < lo) return result;
+        auto guard = buffer_manager.get_epoch_manager().enter();
+        scan_leaves(lo, [&](LeafNode &leaf, uint32_t begin) {
+            uint32_t end = leaf.lower_bound(hi).first;
+            if (end < leaf.count && leaf.key_at(end) == hi) {
+                ++end;
+            }
+            auto run = static_cast<uint32_t>(std::min<size_t>(end - begin, max - result.count));
+            if constexpr (decltype(leaf.slots)::kColumnar) {
+                std::memcpy(keys_out + result.count, leaf.slots.keys + begin, run * sizeof(KeyT));
+                std::memcpy(values_out + result.count, leaf.slots.values + begin, run * sizeof(ValueT));
+            } else {
+                for (uint32_t i = 0; i < run; ++i) {
+                    keys_out[result.count + i] = leaf.key_at(begin + i);
+                    values_out[result.count + i] = leaf.value_at(begin + i);
+                }
+            }
+            result.count += run;
+            if (begin + run < end) {
+                // The output is full, remember where to continue.
+                result.has_more = true;
+                result.resume_key = leaf.key_at(begin + run);
+                return false;
+            }
+            return end == leaf.count;
+        });
+        return result;
+    }
+
+    /// A range scan that is continued in batches, see `next_batch()`.
+    /// No page stays fixed between batches, so writers are not blocked. The
+    /// cursor remembers the leaf of the next entry with the version the leaf
+    /// had and the slot. If neither the leaf nor the structure of the tree
+    /// changed, the next batch continues there without a descent. Otherwise
+    /// it descends to the first key after the last produced key. Entries that
+    /// are inserted behind the cursor are seen, entries that are erased before
+    /// the cursor reaches them are not.
+    struct Cursor {
+        /// The smallest key of the range.
+        KeyT lo;
+        /// The largest key of the range.
+        KeyT hi;
+        /// The last key that was produced.
+        std::optional<KeyT> last_key;
+        /// The leaf of the next entry, nullopt before the first batch.
+        std::optional<uint64_t> leaf;
+        /// The version of the leaf when the cursor left it.
+        uint32_t leaf_version = 0;
+        /// The structure version of the tree when the cursor left the leaf.
+        uint64_t structure_version = 0;
+        /// The slot of the next entry in the leaf.
+        uint32_t slot = 0;
+        /// The largest key that can be in the leaf, nullopt for the last leaf.
+        std::optional<KeyT> leaf_upper;
+        /// Was the end of the range reached?
+        bool done = false;
+        /// The number of descents from the root.
+        size_t descents = 0;
+
+        /// Constructor.
+        Cursor(const KeyT &lo, const KeyT &hi) : lo(lo), hi(hi), done(hi < lo) {}
+    };
+
+    /// Opens a cursor over the entries with keys in [lo, hi].
+    /// @param[in] lo       The smallest key of the range.
+    /// @param[in] hi       The largest key of the range.
+    Cursor open_cursor(const KeyT &lo, const KeyT &hi) {
+        return Cursor(lo, hi);
+    }
+
+    /// Copies the next entries of a cursor into caller-provided arrays.
+    /// @param[in]  cursor      The cursor, it is advanced past the entries.
+    /// @param[out] keys_out    The keys, must have room for `max` keys.
+    /// @param[out] values_out  The values, must have room for `max` values.
+    /// @param[in]  max         The maximum number of entries to produce.
+    /// @return                 The number of entries, less than `max` only at
+    ///                         the end of the range.
+    size_t next_batch(Cursor &cursor, KeyT *keys_out, ValueT *values_out, size_t max) {
+        if (cursor.done || max == 0) return 0;
+        if (!root) {
+            cursor.done = true;
+            return 0;
+        }
+        auto guard = buffer_manager.get_epoch_manager().enter();
+
+        // Continue in the leaf of the cursor if it did not change.
+        Frame* frame = nullptr;
+        if (cursor.leaf && cursor.structure_version == structure_version) {
+            frame = &read_node(cursor.leaf.value());
+            if (reinterpret_cast<LeafNode*>(frame->get_data())->version != cursor.leaf_version) {
+                release_node(*frame);
+                frame = nullptr;
+            }
+        }
+        if (!frame) {
+            frame = cursor.last_key ? &seek(cursor, *cursor.last_key, true) : &seek(cursor, cursor.lo, false);
+        }
+
+        size_t count = 0;
+        while (true) {
+            auto* leaf = reinterpret_cast<LeafNode*>(frame->get_data());
+            while (count < max && cursor.slot < leaf->count && !(cursor.hi < leaf->key_at(cursor.slot))) {
+                keys_out[count] = leaf->key_at(cursor.slot);
+                values_out[count] = leaf->value_at(cursor.slot);
+                ++count;
+                ++cursor.slot;
+            }
+            if (cursor.slot < leaf->count) {
+                cursor.done = cursor.hi < leaf->key_at(cursor.slot);
+                break;
+            }
+            if (!cursor.leaf_upper || !(*cursor.leaf_upper < cursor.hi)) {
+                cursor.done = true;
+                break;
+            }
+            // The output is full, the next batch moves on to the next leaf.
+            if (count == max) break;
+            KeyT upper = *cursor.leaf_upper;
+            release_node(*frame);
+            frame = &seek(cursor, upper, true);
+        }
+        release_node(*frame);
+        if (count > 0) cursor.last_key = keys_out[count - 1];
+        return count;
+    }
+
+    /// Descends to the leaf of the first key that is not less than, or with
+    /// `exclusive` greater than, a bound and positions a cursor there.
+    /// Must be called inside an epoch.
+    /// @return             The frame of the leaf, see `read_node()`.
+    Frame& seek(Cursor &cursor, const KeyT &bound, bool exclusive) {
+        cursor.leaf_upper.reset();
+        uint64_t pageID = root.value();
+        Frame* frame = &read_node(pageID);
+        auto* node = reinterpret_cast<Node*>(frame->get_data());
+        while (!node->is_leaf()) {
+            auto* inner = reinterpret_cast<InnerNode*>(node);
+            auto [idx, found] = inner->lower_bound(bound);
+            if (!found) {
+                idx = inner->count - 1;
+            } else if (exclusive && inner->keys[idx] == bound) {
+                ++idx;
+            }
+            if (idx + 1u < inner->count) cursor.leaf_upper = inner->keys[idx];
+            pageID = inner->child_id(idx);
+            Frame* next = &read_node(pageID);
+            release_node(*frame);
+            frame = next;
+            node = reinterpret_cast<Node*>(frame->get_data());
+        }
+        auto* leaf = reinterpret_cast<LeafNode*>(node);
+        uint32_t slot = leaf->lower_bound(bound).first;
+        if (exclusive && slot < leaf->count && leaf->key_at(slot) == bound) ++slot;
+        cursor.leaf = pageID;
+        cursor.leaf_version = leaf->version;
+        cursor.structure_version = structure_version;
+        cursor.slot = slot;
+        ++cursor.descents;
+        return *frame;
     }
 
     /// Erase an entry in the tree.
     /// @param[in] key      The key that should be searched.
     void erase(const KeyT &key) {
+        if (lookup_cache) lookup_cache->erase(key);
         if (!root) return;
+        root = make_writable(root.value());
 
-        std::tuple<BufferFrame*, Node*> current = get_initial_node(root.value());
-        std::tuple<BufferFrame*, Node*> parent = { nullptr, nullptr };
+        std::tuple<Frame*, Node*> current = get_initial_node(root.value());
+        std::tuple<Frame*, Node*> parent = { nullptr, nullptr };
+        bool parentIsDirty = false;
 
+        // The parent of the leaf stays fixed until `remove_from_parent()` wrote
+        // to it, so that it is neither evicted nor unswizzled meanwhile.
         while (!std::get<1>(current)->is_leaf()) {
+            if (std::get<0>(parent)) pages.unfix_page(*std::get<0>(parent), parentIsDirty);
             parent = current;
-            current = navigate_to_child(key, current);
+            parentIsDirty = false;
+            current = navigate_to_child(key, parent, parentIsDirty);
         }
 
         LeafNode* leaf = reinterpret_cast<LeafNode*>(std::get<1>(current));
@@ -335,29 +1271,41 @@ struct BTree : public Segment {
 
         if (leaf->count <= 0 && std::get<0>(parent)) {
             remove_from_parent(key, parent);
+            parentIsDirty = true;
         }
         
-        buffer_manager.unfix_page(*std::get<0>(current), true);
+        pages.unfix_page(*std::get<0>(current), true);
+        if (std::get<0>(parent)) pages.unfix_page(*std::get<0>(parent), parentIsDirty);
+        ++key_filter_erases;
+        refresh_key_filter();
     }
 
-    std::tuple<BufferFrame*, Node*> get_initial_node(uint64_t pageID) {
-        BufferFrame* currentFrame = &buffer_manager.fix_page(pageID, false);
+    std::tuple<Frame*, Node*> get_initial_node(uint64_t pageID) {
+        Frame* currentFrame = &pages.fix_page(pageID, true);
         Node* currentNode = reinterpret_cast<Node*>(currentFrame->get_data());
         return { currentFrame, currentNode };
     }
 
-    std::tuple<BufferFrame*, Node*> navigate_to_child(const KeyT& key, const std::tuple<BufferFrame*, Node*>& current) {
+    /// Fixes the child of an inner node that holds a key, the inner node stays fixed.
+    /// @param[in]  key     The key.
+    /// @param[in]  current The inner node.
+    /// @param[out] isDirty Set if the reference to the child was replaced.
+    std::tuple<Frame*, Node*> navigate_to_child(const KeyT& key, const std::tuple<Frame*, Node*>& current, bool &isDirty) {
         InnerNode* inner = reinterpret_cast<InnerNode*>(std::get<1>(current));
         auto [childIdx, exactMatch] = inner->lower_bound(key);
         if (!exactMatch) childIdx = std::get<1>(current)->count - 1;
         
-        uint64_t nextPage = inner->children[childIdx];
-        buffer_manager.unfix_page(*std::get<0>(current), false);
+        uint64_t childID = inner->child_id(childIdx);
+        uint64_t nextPage = make_writable(childID);
+        if (nextPage != childID) {
+            inner->children[childIdx] = nextPage;
+            isDirty = true;
+        }
 
         return get_initial_node(nextPage);
     }
 
-    void remove_from_parent(const KeyT& key, const std::tuple<BufferFrame*, Node*>& parent) {
+    void remove_from_parent(const KeyT& key, const std::tuple<Frame*, Node*>& parent) {
         InnerNode* parentNode = reinterpret_cast<InnerNode*>(std::get<1>(parent));
         auto [parentIdx, found] = parentNode->lower_bound(key);
         if (found && parentNode->keys[parentIdx] == key) {
@@ -365,20 +1313,164 @@ struct BTree : public Segment {
             memmove(parentNode->keys + parentIdx, parentNode->keys + parentIdx + 1, temp * sizeof(KeyT));
             memmove(parentNode->children + parentIdx, parentNode->children + parentIdx + 1, temp * sizeof(ValueT));
             parentNode->count--;
+            parentNode->update_index();
+        }
+    }
+
+    /// Erase all entries with keys in [lo, hi].
+    /// The boundary leaves are trimmed, subtrees that are covered by the range are
+    /// unlinked as a whole. Their pages are returned to the allocator without
+    /// visiting the leaves.
+    /// @param[in] lo       The smallest key that should be erased.
+    /// @param[in] hi       The largest key that should be erased.
+    void erase_range(const KeyT &lo, const KeyT &hi) {
+        if (!root || hi < lo) return;
+        if (lookup_cache) lookup_cache->erase_range(lo, hi);
+        Defer reclaim([&]() { reclaim_pages(); });
+        root = make_writable(root.value());
+
+        auto& rootFrame = pages.fix_page(root.value(), false);
+        bool rootIsLeaf = reinterpret_cast<Node*>(rootFrame.get_data())->is_leaf();
+        pages.unfix_page(rootFrame, false);
+
+        size_t erased = 0;
+        if (erase_range_in(root.value(), lo, hi, erased) && !rootIsLeaf) {
+            free_page(root.value());
+            root.reset();
+        }
+
+        // Remove roots that were left with a single child.
+        while (root) {
+            auto& frame = pages.fix_page(root.value(), false);
+            auto* node = reinterpret_cast<Node*>(frame.get_data());
+            if (node->is_leaf() || node->count != 1) {
+                pages.unfix_page(frame, false);
+                break;
+            }
+            uint64_t oldRoot = root.value();
+            root = reinterpret_cast<InnerNode*>(node)->child_id(0);
+            pages.unfix_page(frame, false);
+            free_page(oldRoot);
+        }
+        key_filter_erases += erased;
+        refresh_key_filter();
+    }
+
+    /// Erase all entries with keys in [lo, hi] in the subtree of a node.
+    /// @param[in]  pageID  The node.
+    /// @param[in]  lo      The smallest key that should be erased.
+    /// @param[in]  hi      The largest key that should be erased.
+    /// @param[out] erased  Incremented by the number of erased entries. The
+    ///                     leaves of covered subtrees are not visited, they
+    ///                     count as full.
+    /// @return             Whether the node is empty afterwards.
+    bool erase_range_in(uint64_t pageID, const KeyT &lo, const KeyT &hi, size_t &erased) {
+        auto& frame = pages.fix_page(pageID, true);
+        auto* node = reinterpret_cast<Node*>(frame.get_data());
+        if (node->is_leaf()) {
+            auto* leaf = reinterpret_cast<LeafNode*>(node);
+            uint32_t before = leaf->count;
+            leaf->erase_range(lo, hi);
+            erased += before - leaf->count;
+            bool isEmpty = leaf->count == 0;
+            pages.unfix_page(frame, true);
+            return isEmpty;
+        }
+
+        auto* inner = reinterpret_cast<InnerNode*>(node);
+        uint32_t first = inner->child_slot(lo);
+        uint32_t last = inner->child_slot(hi);
+        bool removed[InnerNode::kCapacity] = {};
+        inner->children[first] = make_writable(inner->child_id(first));
+        inner->children[last] = make_writable(inner->child_id(last));
+
+        // The children strictly between the boundary children are covered completely.
+        for (uint32_t i = first + 1; i < last; ++i) {
+            erased += free_subtree(inner->child_id(i)) * LeafNode::kCapacity;
+            removed[i] = true;
+        }
+        if (erase_range_in(inner->children[first], lo, hi, erased)) {
+            free_page(inner->children[first]);
+            removed[first] = true;
+        }
+        if (last != first && erase_range_in(inner->children[last], lo, hi, erased)) {
+            free_page(inner->children[last]);
+            removed[last] = true;
+        }
+
+        // Compact the children, every child keeps its upper bound as separator.
+        uint32_t kept = 0;
+        for (uint32_t i = 0; i < inner->count; ++i) {
+            if (removed[i]) continue;
+            inner->children[kept] = inner->children[i];
+            if (i + 1u < inner->count) {
+                inner->keys[kept] = inner->keys[i];
+            }
+            ++kept;
         }
+        inner->count = kept;
+        inner->update_index();
+        pages.unfix_page(frame, true);
+        return kept == 0;
+    }
+
+    /// Frees all pages of a subtree, the leaves are not fixed.
+    /// @return             The number of leaves that were freed.
+    size_t free_subtree(uint64_t pageID) {
+        auto& frame = pages.fix_page(pageID, false);
+        auto* node = reinterpret_cast<Node*>(frame.get_data());
+        size_t leaves = 0;
+        if (node->is_leaf()) {
+            leaves = 1;
+        } else {
+            auto* inner = reinterpret_cast<InnerNode*>(node);
+            for (uint32_t i = 0; i < inner->count; ++i) {
+                if (inner->level == 1) {
+                    free_page(inner->child_id(i));
+                    ++leaves;
+                } else {
+                    leaves += free_subtree(inner->child_id(i));
+                }
+            }
+        }
+        pages.unfix_page(frame, false);
+        free_page(pageID);
+        return leaves;
     }
 
     /// Inserts a new entry into the tree.
     /// @param[in] key      The key that should be inserted.
     /// @param[in] value    The value that should be inserted.
     void insert(const KeyT& key, const ValueT& value) {
+        upsert(key, [&](ValueT*) { return std::optional<ValueT>(value); });
+    }
+
+    /// Inserts, updates or erases an entry depending on its current value.
+    /// The leaf is reached with a single exclusive descent, that splits full
+    /// nodes on the way like `insert()`, and the entry is modified in place.
+    /// @param[in] key      The key of the entry.
+    /// @param[in] fn       Called once with a pointer to the value of the key,
+    ///                     or nullptr if the key is not in the tree. Returns the
+    ///                     new value, or std::nullopt to erase the entry.
+    template<typename FnT>
+    void upsert(const KeyT& key, FnT&& fn) {
+        // Swizzled references are followed inside an epoch, see `fix_child()`.
+        auto guard = buffer_manager.get_epoch_manager().enter();
+        // The value of an absent key, computed before the leaf is split.
+        std::optional<ValueT> newValue;
+        Frame* currentBuffer;
         if (!root) {
-            root = 0;
-            next_page_id = 1;
+            newValue = fn(nullptr);
+            if (!newValue) return;
+            add_to_key_filter(key);
+            root = allocate_page();
+            currentBuffer = &pages.fix_page(root.value(), true);
+            new (currentBuffer->get_data()) LeafNode();
+        } else {
+            root = make_writable(root.value());
+            currentBuffer = &pages.fix_page(root.value(), true);
         }
-
-        BufferFrame* currentBuffer = &buffer_manager.fix_page(root.value(), true);
-        BufferFrame* parentBuffer = nullptr;
+        Frame* parentBuffer = nullptr;
         bool currentIsDirty = false;
         bool parentIsDirty = false;
 
@@ -389,30 +1481,64 @@ struct BTree : public Segment {
             if (currentNode->is_leaf()) {
                 LeafNode* leaf = reinterpret_cast<LeafNode*>(currentNode);
 
+                // Modify an existing entry in place
+                uint32_t slot = leaf->find(key);
+                if (slot < leaf->count) {
+                    if (auto result = fn(&leaf->value_at(slot))) {
+                        leaf->value_at(slot) = *result;
+                        adapt_leaf(*leaf);
+                        if (lookup_cache) lookup_cache->update(key, *result);
+                    } else {
+                        leaf->moveDataToLeftFrom(slot);
+                        adapt_leaf(*leaf);
+                        if (lookup_cache) lookup_cache->erase(key);
+                        ++key_filter_erases;
+                        if (leaf->count == 0 && parentBuffer) {
+                            remove_from_parent(key, {parentBuffer, reinterpret_cast<Node*>(parentBuffer->get_data())});
+                            parentIsDirty = true;
+                        }
+                    }
+                    pages.unfix_page(*currentBuffer, true);
+                    if (parentBuffer) pages.unfix_page(*parentBuffer, parentIsDirty);
+                    refresh_key_filter();
+                    return;
+                }
+                if (!newValue) {
+                    newValue = fn(nullptr);
+                    if (!newValue) {
+                        pages.unfix_page(*currentBuffer, currentIsDirty);
+                        if (parentBuffer) pages.unfix_page(*parentBuffer, parentIsDirty);
+                        return;
+                    }
+                    add_to_key_filter(key);
+                }
+
                 // If there's space in the leaf, insert and exit
-                if (leaf->count < 42) {
-                    leaf->insert(key, value);
+                if (leaf->count < LeafNode::kCapacity) {
+                    leaf->insert(key, *newValue);
+                    adapt_leaf(*leaf);
                     currentIsDirty = true;
 
-                    buffer_manager.unfix_page(*currentBuffer, currentIsDirty);
-                    if (parentBuffer) buffer_manager.unfix_page(*parentBuffer, parentIsDirty);
+                    pages.unfix_page(*currentBuffer, currentIsDirty);
+                    if (parentBuffer) pages.unfix_page(*parentBuffer, parentIsDirty);
+                    refresh_key_filter();
                     return;
                 }
 
                 // If leaf is full, handle the split
-                uint64_t newLeafID = next_page_id++;
-                BufferFrame* newLeafBuffer = &buffer_manager.fix_page(newLeafID, true);
+                uint64_t newLeafID = allocate_page();
+                Frame* newLeafBuffer = &pages.fix_page(newLeafID, true);
                 KeyT splitKey = leaf->split(reinterpret_cast<std::byte *>(newLeafBuffer->get_data()));
                 currentIsDirty = true;
 
                 // Update the parent node after the split
                 if (!parentBuffer) {
                     uint64_t oldLeafID = root.value();
-                    root = next_page_id++;
-                    parentBuffer = &buffer_manager.fix_page(root.value(), true);
+                    root = allocate_page();
+                    parentBuffer = &pages.fix_page(root.value(), true);
                     parentIsDirty = true;
 
-                    InnerNode* rootAsInner = reinterpret_cast<InnerNode*>(parentBuffer->get_data());
+                    InnerNode* rootAsInner = new (parentBuffer->get_data()) InnerNode();
                     rootAsInner->level = 1;
                     rootAsInner->insert(splitKey, oldLeafID);
                     rootAsInner->insert(splitKey, newLeafID);
@@ -423,25 +1549,26 @@ struct BTree : public Segment {
                 }
 
                 // Decide which buffer to continue with
-                buffer_manager.unfix_page((key < splitKey) ? *newLeafBuffer : *currentBuffer, currentIsDirty);
-                if (key >= splitKey) currentBuffer = newLeafBuffer;
+                pages.unfix_page((key <= splitKey) ? *newLeafBuffer : *currentBuffer, currentIsDirty);
+                if (key > splitKey) currentBuffer = newLeafBuffer;
 
             } else { // Handle inner node
                 InnerNode* inner = reinterpret_cast<InnerNode*>(currentNode);
 
                 // If the inner node is full, split it
-                if (inner->count == 42) {
-                    uint64_t newInnerID = next_page_id++;
-                    BufferFrame* newInnerBuffer = &buffer_manager.fix_page(newInnerID, true);
+                if (inner->count == InnerNode::kCapacity) {
+                    uint64_t newInnerID = allocate_page();
+                    Frame* newInnerBuffer = &pages.fix_page(newInnerID, true);
                     KeyT splitKey = inner->split(reinterpret_cast<std::byte *>(newInnerBuffer->get_data()));
                     currentIsDirty = true;
 
                     if (!parentBuffer) {
                         uint64_t oldInnerID = root.value();
-                        root = next_page_id++;
-                        parentBuffer = &buffer_manager.fix_page(root.value(), true);
+                        root = allocate_page();
+                        parentBuffer = &pages.fix_page(root.value(), true);
+                        parentIsDirty = true;
 
-                        InnerNode* rootAsInner = reinterpret_cast<InnerNode*>(parentBuffer->get_data());
+                        InnerNode* rootAsInner = new (parentBuffer->get_data()) InnerNode();
                         rootAsInner->level = inner->level + 1;
                         rootAsInner->insert(splitKey, oldInnerID);
                         rootAsInner->insert(splitKey, newInnerID);
@@ -451,19 +1578,365 @@ struct BTree : public Segment {
                         parentIsDirty = true;
                     }
 
-                    buffer_manager.unfix_page((key < splitKey) ? *newInnerBuffer : *currentBuffer, currentIsDirty);
-                    if (key >= splitKey) currentBuffer = newInnerBuffer;
+                    pages.unfix_page((key <= splitKey) ? *newInnerBuffer : *currentBuffer, currentIsDirty);
+                    if (key > splitKey) currentBuffer = newInnerBuffer;
 
                 } else { // Move deeper into the tree
-                    auto boundary = inner->lower_bound(key);
-                    uint64_t childID = boundary.second ? inner->children[boundary.first] : inner->children[inner->count - 1];
+                    uint32_t slot = inner->child_slot(key);
+                    uint64_t childID = make_writable(inner->child_id(slot));
+                    if (childID != inner->child_id(slot)) {
+                        inner->children[slot] = childID;
+                        currentIsDirty = true;
+                    }
 
-                    if (parentBuffer) buffer_manager.unfix_page(*parentBuffer, parentIsDirty);
+                    if (parentBuffer) pages.unfix_page(*parentBuffer, parentIsDirty);
                     parentBuffer = currentBuffer;
-                    currentBuffer = &buffer_manager.fix_page(childID, true);
+                    parentIsDirty = currentIsDirty;
+                    currentBuffer = snapshot_versions.empty() ? &pages.fix_child(inner->children[slot], true)
+                                                              : &pages.fix_page(childID, true);
+                    currentIsDirty = false;
+                }
+            }
+        }
+    }
+
+    /// Inserts an entry unless the key is already in the tree, see `upsert()`.
+    /// @param[in] key      The key that should be inserted.
+    /// @param[in] value    The value that should be inserted.
+    /// @return             Whether the entry was inserted.
+    bool insert_if_absent(const KeyT& key, const ValueT& value) {
+        bool inserted = false;
+        upsert(key, [&](ValueT* current) {
+            inserted = !current;
+            return std::optional<ValueT>(current ? *current : value);
+        });
+        return inserted;
+    }
+
+    /// Replaces the value of a key if it equals an expected value, see `upsert()`.
+    /// @param[in] key      The key of the entry.
+    /// @param[in] expected The value that the entry must have.
+    /// @param[in] desired  The new value of the entry.
+    /// @return             Whether the value was replaced, false if the key is
+    ///                     not in the tree or has another value.
+    bool compare_and_swap(const KeyT& key, const ValueT& expected, const ValueT& desired) {
+        bool swapped = false;
+        upsert(key, [&](ValueT* current) -> std::optional<ValueT> {
+            if (!current) return std::nullopt;
+            swapped = *current == expected;
+            return swapped ? desired : *current;
+        });
+        return swapped;
+    }
+
+    /// The number of sampled keys per partition of `build_parallel()`.
+    static constexpr size_t kSamplesPerPartition = 32;
+
+    /// Replaces the content of the tree with unsorted entries, using a thread pool.
+    /// The input is split into key ranges by splitters drawn from a sample. The
+    /// partitions are sorted concurrently and every partition is written as a run
+    /// of leaves into its own range of fresh pages, so the threads never allocate
+    /// from the shared free list. The inner levels are stitched together over all
+    /// runs afterwards. If a key occurs more than once, the last occurrence wins
+    /// like with repeated `insert()` calls.
+    /// @param[in] entries  The entries in any order.
+    /// @param[in] pool     The thread pool, waits for all of its tasks.
+    void build_parallel(std::vector<std::pair<KeyT, ValueT>> entries, ThreadPool &pool) {
+        if (lookup_cache) lookup_cache->clear();
+        ++structure_version;
+        if (root) {
+            free_subtree(root.value());
+            root.reset();
+        }
+        if (entries.empty()) {
+            refresh_key_filter(true);
+            return;
+        }
+
+        // Take the splitters from a sorted sample, partition `p` holds the keys
+        // in (splitters[p - 1], splitters[p]].
+        size_t partitions = std::min(pool.size() * 4, entries.size() / LeafNode::kCapacity + 1);
+        size_t sampleCount = partitions * kSamplesPerPartition;
+        std::vector<KeyT> sample;
+        sample.reserve(sampleCount);
+        for (size_t i = 0; i < sampleCount; ++i) {
+            sample.push_back(entries[i * entries.size() / sampleCount].first);
+        }
+        std::sort(sample.begin(), sample.end());
+        std::vector<KeyT> splitters;
+        for (size_t p = 1; p < partitions; ++p) {
+            splitters.push_back(sample[p * sampleCount / partitions]);
+        }
+        splitters.erase(std::unique(splitters.begin(), splitters.end()), splitters.end());
+        partitions = splitters.size() + 1;
+
+        // Distribute the chunks of the input to the partitions concurrently.
+        using Entry = std::pair<KeyT, ValueT>;
+        std::vector<std::vector<std::vector<Entry>>> chunks(partitions, std::vector<std::vector<Entry>>(partitions));
+        for (size_t c = 0; c < partitions; ++c) {
+            pool.submit([&, c] {
+                size_t begin = entries.size() * c / partitions;
+                size_t end = entries.size() * (c + 1) / partitions;
+                for (size_t i = begin; i < end; ++i) {
+                    size_t p = std::lower_bound(splitters.begin(), splitters.end(), entries[i].first) - splitters.begin();
+                    chunks[c][p].push_back(entries[i]);
+                }
+            });
+        }
+        pool.wait();
+        entries = {};
+
+        // Sort every partition, the chunks are concatenated in input order and the
+        // sort is stable, so the last occurrence of a key is the last one in its run.
+        std::vector<std::vector<Entry>> runs(partitions);
+        for (size_t p = 0; p < partitions; ++p) {
+            pool.submit([&, p] {
+                auto& run = runs[p];
+                for (size_t c = 0; c < partitions; ++c) {
+                    run.insert(run.end(), chunks[c][p].begin(), chunks[c][p].end());
+                    chunks[c][p] = {};
+                }
+                std::stable_sort(run.begin(), run.end(), [](const Entry &a, const Entry &b) {
+                    return a.first < b.first;
+                });
+                size_t kept = 0;
+                for (size_t i = 0; i < run.size(); ++i) {
+                    if (kept > 0 && run[kept - 1].first == run[i].first) {
+                        run[kept - 1] = run[i];
+                    } else {
+                        run[kept++] = run[i];
+                    }
+                }
+                run.resize(kept);
+            });
+        }
+        pool.wait();
+
+        // Reserve a range of pages for the leaves of every run.
+        std::vector<size_t> firstLeaf(partitions + 1, 0);
+        for (size_t p = 0; p < partitions; ++p) {
+            firstLeaf[p + 1] = firstLeaf[p] + (runs[p].size() + LeafNode::kCapacity - 1) / LeafNode::kCapacity;
+        }
+        uint64_t firstPage = next_page_id;
+        next_page_id += firstLeaf[partitions];
+        page_versions.resize(next_page_id, write_version);
+
+        // Write the leaves, the entries of a run are spread evenly over its leaves.
+        std::vector<std::pair<KeyT, uint64_t>> leaves(firstLeaf[partitions]);
+        for (size_t p = 0; p < partitions; ++p) {
+            pool.submit([&, p] {
+                const auto& run = runs[p];
+                size_t leafCount = firstLeaf[p + 1] - firstLeaf[p];
+                for (size_t l = 0; l < leafCount; ++l) {
+                    size_t begin = run.size() * l / leafCount;
+                    size_t end = run.size() * (l + 1) / leafCount;
+                    uint64_t pageID = BufferManager::get_overall_page_id(segment_id, firstPage + firstLeaf[p] + l);
+                    auto& frame = pages.fix_page(pageID, true);
+                    auto* leaf = new (frame.get_data()) LeafNode();
+                    for (size_t i = begin; i < end; ++i) {
+                        leaf->slots.set(static_cast<uint32_t>(i - begin), run[i].first, run[i].second);
+                    }
+                    leaf->count = static_cast<uint16_t>(end - begin);
+                    pages.unfix_page(frame, true);
+                    leaves[firstLeaf[p] + l] = {run[end - 1].first, pageID};
+                }
+            });
+        }
+        pool.wait();
+
+        build_inner_levels(std::move(leaves));
+        refresh_key_filter(true);
+    }
+
+    /// Builds the inner levels over a sequence of nodes and makes the top node the root.
+    /// The children are spread evenly over the nodes of every level.
+    /// @param[in] nodes    The largest key and the page id of every node of the
+    ///                     bottom level, in key order.
+    /// @param[in] level    The level of the parents of the bottom level.
+    void build_inner_levels(std::vector<std::pair<KeyT, uint64_t>> nodes, uint16_t level = 1) {
+        while (nodes.size() > 1) {
+            size_t parentCount = (nodes.size() + InnerNode::kCapacity - 1) / InnerNode::kCapacity;
+            std::vector<std::pair<KeyT, uint64_t>> parents;
+            for (size_t n = 0; n < parentCount; ++n) {
+                size_t begin = nodes.size() * n / parentCount;
+                size_t end = nodes.size() * (n + 1) / parentCount;
+                uint64_t pageID = allocate_page();
+                auto& frame = pages.fix_page(pageID, true);
+                auto* inner = new (frame.get_data()) InnerNode();
+                inner->level = level;
+                inner->count = static_cast<uint16_t>(end - begin);
+                for (size_t i = begin; i < end; ++i) {
+                    inner->children[i - begin] = nodes[i].second;
+                    if (i + 1 < end) {
+                        inner->keys[i - begin] = nodes[i].first;
+                    }
+                }
+                inner->update_index();
+                pages.unfix_page(frame, true);
+                parents.emplace_back(nodes[end - 1].first, pageID);
+            }
+            nodes = std::move(parents);
+            ++level;
+        }
+        root = nodes.empty() ? std::nullopt : std::optional<uint64_t>(nodes.front().second);
+    }
+
+    /// Merges a sorted run of entries into the tree.
+    /// The run is routed through the inner nodes once. Every leaf that receives
+    /// entries is merged with them in a single pass and rewritten once, overflowing
+    /// entries go into new leaves that are built in sequence. Only the inner nodes
+    /// above affected leaves are rewritten, they are split evenly when the new
+    /// children do not fit. Entries of the run replace entries with equal keys.
+    /// @param[in] run      The entries sorted by key, if a key occurs more than
+    ///                     once the last occurrence wins.
+    void merge_from(const std::vector<std::pair<KeyT, ValueT>> &run) {
+        if (run.empty()) return;
+        ++structure_version;
+        for (auto& entry : run) {
+            add_to_key_filter(entry.first);
+            if (lookup_cache) lookup_cache->update(entry.first, entry.second);
+        }
+        if (!root) {
+            root = allocate_page();
+            auto& frame = pages.fix_page(root.value(), true);
+            new (frame.get_data()) LeafNode();
+            pages.unfix_page(frame, true);
+        }
+
+        auto& frame = pages.fix_page(root.value(), false);
+        uint16_t rootLevel = reinterpret_cast<Node*>(frame.get_data())->level;
+        pages.unfix_page(frame, false);
+
+        auto nodes = merge_into(root.value(), run.data(), run.data() + run.size(), nullptr);
+        if (nodes.size() > 1) {
+            build_inner_levels(std::move(nodes), rootLevel + 1);
+        } else {
+            root = nodes.front().second;
+        }
+        refresh_key_filter();
+    }
+
+    /// Applies the writes that a derived tree keeps outside the leaves, like the
+    /// messages of `BufferedBTree`, so that the leaves hold all entries. A plain
+    /// tree writes to the leaves directly.
+    virtual void flush_all() {}
+
+    /// Merges all entries of another tree into the tree, see `merge_from()`.
+    /// The other tree is read through its leaves, its pending writes are applied
+    /// to them first.
+    /// @param[in] other    The other tree, its entries are not modified.
+    void merge_from(BTree &other) {
+        other.flush_all();
+        if (!other.root) return;
+        std::vector<std::pair<KeyT, ValueT>> run;
+        auto collect = [&](LeafNode &leaf, uint32_t) {
+            for (uint32_t i = 0; i < leaf.count; ++i) {
+                run.emplace_back(leaf.key_at(i), leaf.value_at(i));
+            }
+            return true;
+        };
+        other.scan_all_leaves(collect);
+        merge_from(run);
+    }
+
+    /// Merges the entries [begin, end) of a sorted run into the subtree of a node.
+    /// @param[in] upper    An upper bound of the keys in the subtree, or nullptr if
+    ///                     the subtree is the rightmost one.
+    /// @return             The nodes that replace the node, as pairs of an upper
+    ///                     bound of their keys and their page id. The node itself is
+    ///                     the first one. The bound of the rightmost node of the tree
+    ///                     is meaningless, it never becomes a separator.
+    std::vector<std::pair<KeyT, uint64_t>> merge_into(uint64_t pageID,
+                                                      const std::pair<KeyT, ValueT> *begin,
+                                                      const std::pair<KeyT, ValueT> *end,
+                                                      const KeyT *upper) {
+        pageID = make_writable(pageID);
+        auto& frame = pages.fix_page(pageID, true);
+        auto* node = reinterpret_cast<Node*>(frame.get_data());
+        std::vector<std::pair<KeyT, uint64_t>> result;
+
+        if (node->is_leaf()) {
+            auto* leaf = reinterpret_cast<LeafNode*>(node);
+            std::vector<std::pair<KeyT, ValueT>> merged;
+            merged.reserve(leaf->count + (end - begin));
+            uint32_t i = 0;
+            for (auto* entry = begin; entry != end; ++entry) {
+                while (i < leaf->count && leaf->key_at(i) < entry->first) {
+                    merged.emplace_back(leaf->key_at(i), leaf->value_at(i));
+                    ++i;
+                }
+                if (i < leaf->count && leaf->key_at(i) == entry->first) {
+                    ++i;
+                }
+                if (!merged.empty() && merged.back().first == entry->first) {
+                    merged.back().second = entry->second;
+                } else {
+                    merged.push_back(*entry);
+                }
+            }
+            for (; i < leaf->count; ++i) {
+                merged.emplace_back(leaf->key_at(i), leaf->value_at(i));
+            }
+
+            size_t leafCount = (merged.size() + LeafNode::kCapacity - 1) / LeafNode::kCapacity;
+            for (size_t l = 0; l < leafCount; ++l) {
+                size_t first = merged.size() * l / leafCount;
+                size_t last = merged.size() * (l + 1) / leafCount;
+                uint64_t leafID = l == 0 ? pageID : allocate_page();
+                auto& leafFrame = l == 0 ? frame : pages.fix_page(leafID, true);
+                auto* out = new (leafFrame.get_data()) LeafNode();
+                for (size_t j = first; j < last; ++j) {
+                    out->slots.set(static_cast<uint32_t>(j - first), merged[j].first, merged[j].second);
+                }
+                out->count = static_cast<uint16_t>(last - first);
+                if (l != 0) pages.unfix_page(leafFrame, true);
+                result.emplace_back(merged[last - 1].first, leafID);
+            }
+            pages.unfix_page(frame, true);
+            return result;
+        }
+
+        // Route the run to the children, only the children that receive entries are visited.
+        auto* inner = reinterpret_cast<InnerNode*>(node);
+        std::vector<std::pair<KeyT, uint64_t>> children;
+        auto* next = begin;
+        for (uint32_t i = 0; i < inner->count; ++i) {
+            bool isLast = i + 1u == inner->count;
+            const KeyT *childUpper = isLast ? upper : &inner->keys[i];
+            auto* childEnd = isLast ? end : std::upper_bound(next, end, inner->keys[i],
+                [](const KeyT &key, const std::pair<KeyT, ValueT> &entry) { return key < entry.first; });
+            if (next == childEnd) {
+                children.emplace_back(childUpper ? *childUpper : KeyT{}, inner->child_id(i));
+            } else {
+                auto replacement = merge_into(inner->child_id(i), next, childEnd, childUpper);
+                children.insert(children.end(), replacement.begin(), replacement.end());
+            }
+            next = childEnd;
+        }
+
+        // Rewrite the node, split it evenly if the children do not fit.
+        size_t nodeCount = (children.size() + InnerNode::kCapacity - 1) / InnerNode::kCapacity;
+        uint16_t level = inner->level;
+        for (size_t n = 0; n < nodeCount; ++n) {
+            size_t first = children.size() * n / nodeCount;
+            size_t last = children.size() * (n + 1) / nodeCount;
+            uint64_t innerID = n == 0 ? pageID : allocate_page();
+            auto& innerFrame = n == 0 ? frame : pages.fix_page(innerID, true);
+            auto* out = new (innerFrame.get_data()) InnerNode();
+            out->level = level;
+            out->count = static_cast<uint16_t>(last - first);
+            for (size_t j = first; j < last; ++j) {
+                out->children[j - first] = children[j].second;
+                if (j + 1 < last) {
+                    out->keys[j - first] = children[j].first;
                 }
             }
+            out->update_index();
+            if (n != 0) pages.unfix_page(innerFrame, true);
+            result.emplace_back(children[last - 1].first, innerID);
         }
+        pages.unfix_page(frame, true);
+        return result;
     }
 };
 
@@ -0,0 +1,524 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "buffer/buffer_manager.h"
+#include "index/btree.h"
+
+namespace buzzdb {
+
+/// A write-optimized B-Tree (B-epsilon tree).
+/// The tail of every inner node page, behind the `InnerNode` itself, holds a
+/// buffer of pending upsert and delete messages. Writes only add a message to
+/// the root buffer. When a buffer runs full, the messages for the child with
+/// the most pending messages are moved down in one batch, so a leaf is
+/// modified once for many messages instead of once per write. Lookups consult
+/// the buffers along their path, the first message for a key that is found is
+/// the newest one.
+/// The node layout is that of `BTree`, so after `flush_all()` the tree can be
+/// read with the plain `BTree` operations as well. The scans, batched and
+/// interleaved lookups and cursors of `BTree` read the leaves directly, they
+/// are overridden to apply the buffered messages first.
+template<typename KeyT, typename ValueT, typename ComparatorT, size_t PageSize,
+         typename... PolicyTs>
+struct BufferedBTree : public BTree<KeyT, ValueT, ComparatorT, PageSize, PolicyTs...> {
+    using Base = BTree<KeyT, ValueT, ComparatorT, PageSize, PolicyTs...>;
+    using Node = typename Base::Node;
+    using InnerNode = typename Base::InnerNode;
+    using LeafNode = typename Base::LeafNode;
+    using Frame = typename Base::Frame;
+
+    /// The kind of a pending modification.
+    enum class MessageKind : uint8_t { Upsert, Delete };
+
+    /// A pending modification of a key.
+    struct Message {
+        /// The key.
+        KeyT key;
+        /// The new value, unused for deletes.
+        ValueT value;
+        /// The kind of the modification.
+        MessageKind kind;
+    };
+
+    /// The offset of the message buffer within an inner node page.
+    static constexpr size_t kBufferOffset =
+        (sizeof(InnerNode) + alignof(Message) - 1) / alignof(Message) * alignof(Message);
+
+    /// The number of messages an inner node can buffer.
+    static constexpr uint32_t kBufferCapacity =
+        (PageSize - kBufferOffset - alignof(Message)) / sizeof(Message);
+
+    /// The messages of an inner node, sorted by key with at most one message per key.
+    struct MessageBuffer {
+        /// The number of messages.
+        uint32_t count;
+        /// The messages.
+        Message messages[kBufferCapacity];
+
+        /// Get the index of the first message whose key is not less than the provided key.
+        uint32_t lower_bound(const KeyT &key) const {
+            uint32_t start = 0;
+            uint32_t end = count;
+            while (start < end) {
+                uint32_t center = start + (end - start) / 2;
+                if (messages[center].key < key) {
+                    start = center + 1;
+                } else {
+                    end = center;
+                }
+            }
+            return start;
+        }
+
+        /// Returns the message for a key, or nullptr.
+        const Message* find(const KeyT &key) const {
+            uint32_t idx = lower_bound(key);
+            return (idx < count && messages[idx].key == key) ? &messages[idx] : nullptr;
+        }
+
+        /// Can the message be added without exceeding the capacity?
+        bool fits(const Message &message) const {
+            return count < kBufferCapacity || find(message.key) != nullptr;
+        }
+
+        /// Adds a message, it replaces an older message for the same key.
+        void put(const Message &message) {
+            uint32_t idx = lower_bound(message.key);
+            if (idx < count && messages[idx].key == message.key) {
+                messages[idx] = message;
+                return;
+            }
+            std::memmove(messages + idx + 1, messages + idx, (count - idx) * sizeof(Message));
+            messages[idx] = message;
+            ++count;
+        }
+
+        /// Removes the messages in [begin, end).
+        void remove(uint32_t begin, uint32_t end) {
+            std::memmove(messages + begin, messages + end, (count - end) * sizeof(Message));
+            count -= end - begin;
+        }
+    };
+
+    static_assert(kBufferCapacity >= 2, "the page is too small for a message buffer");
+    static_assert(kBufferOffset + sizeof(MessageBuffer) <= PageSize, "the message buffer must fit into the page");
+
+    /// A split of a node that still has to be registered in its parent.
+    struct Split {
+        /// The separator, the largest key of the left node.
+        KeyT separator;
+        /// The page id of the new right node.
+        uint64_t page_id;
+    };
+
+    /// Constructor.
+    BufferedBTree(uint16_t segment_id, BufferManager &buffer_manager)
+        : Base(segment_id, buffer_manager) {}
+
+    /// Lookup an entry in the tree.
+    /// @param[in] key      The key that should be searched.
+    /// @return             The value, if the key was in the tree.
+    std::optional<ValueT> lookup(const KeyT &key) {
+        if (!this->root) return {};
+        auto guard = this->buffer_manager.get_epoch_manager().enter();
+
+        Frame* frame = &this->pages.fix_page(*this->root, false);
+        auto* node = reinterpret_cast<Node*>(frame->get_data());
+        while (!node->is_leaf()) {
+            if (const Message* message = buffer_of(*frame)->find(key)) {
+                std::optional<ValueT> result;
+                if (message->kind == MessageKind::Upsert) {
+                    result = message->value;
+                }
+                this->pages.unfix_page(*frame, false);
+                return result;
+            }
+            auto* inner = static_cast<InnerNode*>(node);
+            Frame* child = &this->pages.fix_page(inner->child_id(inner->child_slot(key)), false);
+            this->pages.unfix_page(*frame, false);
+            frame = child;
+            node = reinterpret_cast<Node*>(frame->get_data());
+        }
+
+        auto* leaf = static_cast<LeafNode*>(node);
+        uint32_t slot = leaf->find(key);
+        std::optional<ValueT> result;
+        if (slot < leaf->count) {
+            result = leaf->value_at(slot);
+        }
+        this->pages.unfix_page(*frame, false);
+        return result;
+    }
+
+    /// Looks up a batch of keys, see `BTree::lookup_interleaved()`.
+    /// The buffered messages are applied first.
+    void lookup_interleaved(const KeyT *keys, size_t count, std::optional<ValueT> *out, size_t group = 8) {
+        flush_all();
+        Base::lookup_interleaved(keys, count, out, group);
+    }
+
+    /// Scans all entries with keys in [lo, hi] that pass a filter, see `BTree::scan()`.
+    /// The buffered messages are applied first.
+    template<typename FilterT, typename ConsumerT>
+    void scan(const KeyT &lo, const KeyT &hi, const FilterT &filter, ConsumerT &&consumer) {
+        flush_all();
+        Base::scan(lo, hi, filter, std::forward<ConsumerT>(consumer));
+    }
+
+    /// Scans all entries with keys in [lo, hi], see `BTree::scan()`.
+    /// The buffered messages are applied first.
+    template<typename ConsumerT>
+    void scan(const KeyT &lo, const KeyT &hi, ConsumerT &&consumer) {
+        flush_all();
+        Base::scan(lo, hi, std::forward<ConsumerT>(consumer));
+    }
+
+    /// Scans all entries with keys in [lo, hi] on a thread pool, see
+    /// `BTree::parallel_scan()`. The buffered messages are applied first.
+    template<typename ConsumerT>
+    size_t parallel_scan(const KeyT &lo, const KeyT &hi, ThreadPool &pool, size_t partitions, ConsumerT &&consumer) {
+        flush_all();
+        return Base::parallel_scan(lo, hi, pool, partitions, std::forward<ConsumerT>(consumer));
+    }
+
+    /// Copies the entries with keys in [lo, hi] into caller-provided arrays, see
+    /// `BTree::scan_batch()`. The buffered messages are applied first.
+    typename Base::ScanBatchResult scan_batch(const KeyT &lo, const KeyT &hi, KeyT *keys_out, ValueT *values_out,
+                                              size_t max) {
+        flush_all();
+        return Base::scan_batch(lo, hi, keys_out, values_out, max);
+    }
+
+    /// Copies the next entries of a cursor into caller-provided arrays, see
+    /// `BTree::next_batch()`. `open_cursor()` does not access the tree, the
+    /// messages that were buffered since the last batch are applied here.
+    size_t next_batch(typename Base::Cursor &cursor, KeyT *keys_out, ValueT *values_out, size_t max) {
+        flush_all();
+        return Base::next_batch(cursor, keys_out, values_out, max);
+    }
+
+    /// Replaces the content of the tree with unsorted entries, see
+    /// `BTree::build_parallel()`. The buffered messages are dropped with the old
+    /// content, the new inner nodes start with empty buffers.
+    void build_parallel(std::vector<std::pair<KeyT, ValueT>> entries, ThreadPool &pool) {
+        has_messages = false;
+        Base::build_parallel(std::move(entries), pool);
+        clear_buffers();
+    }
+
+    /// Merges a sorted run of entries into the tree, see `BTree::merge_from()`.
+    /// The buffered messages are applied first, older messages would otherwise
+    /// override the merged entries. The rewritten inner nodes start with empty
+    /// buffers.
+    void merge_from(const std::vector<std::pair<KeyT, ValueT>> &run) {
+        flush_all();
+        Base::merge_from(run);
+        clear_buffers();
+    }
+
+    /// Merges all entries of another tree into the tree, see `BTree::merge_from()`.
+    /// @param[in] other    The other tree, its entries are not modified.
+    void merge_from(Base &other) {
+        flush_all();
+        Base::merge_from(other);
+        clear_buffers();
+    }
+
+    /// Inserts a new entry into the tree.
+    /// @param[in] key      The key that should be inserted.
+    /// @param[in] value    The value that should be inserted.
+    void insert(const KeyT &key, const ValueT &value) {
+        put(Message{key, value, MessageKind::Upsert});
+    }
+
+    /// Erase an entry in the tree.
+    /// @param[in] key      The key that should be erased.
+    void erase(const KeyT &key) {
+        put(Message{key, ValueT{}, MessageKind::Delete});
+    }
+
+    /// Inserts, updates or erases an entry depending on its current value, see
+    /// `BTree::upsert()`. The current value may be buffered, so it is looked up
+    /// and the result is buffered as a new message.
+    template<typename FnT>
+    void upsert(const KeyT &key, FnT &&fn) {
+        auto current = lookup(key);
+        if (auto result = fn(current ? &*current : nullptr)) {
+            insert(key, *result);
+        } else if (current) {
+            erase(key);
+        }
+    }
+
+    /// Erase all entries with keys in [lo, hi].
+    /// The buffered messages are applied first.
+    /// @param[in] lo       The smallest key that should be erased.
+    /// @param[in] hi       The largest key that should be erased.
+    void erase_range(const KeyT &lo, const KeyT &hi) {
+        flush_all();
+        Base::erase_range(lo, hi);
+    }
+
+    /// Snapshots are not supported, they would not see the buffered messages and
+    /// the message buffers are modified in place.
+    typename Base::Snapshot snapshot() = delete;
+
+    /// A key filter is not supported, buffered upserts bypass `BTree::insert()`.
+    void enable_key_filter(size_t bits_per_key = 10) = delete;
+
+    /// A lookup cache is not supported for the same reason.
+    void enable_lookup_cache(size_t capacity) = delete;
+
+    /// Conditional writes are not supported, buffered writes are blind. Use
+    /// `upsert()` instead.
+    bool insert_if_absent(const KeyT &key, const ValueT &value) = delete;
+    bool compare_and_swap(const KeyT &key, const ValueT &expected, const ValueT &desired) = delete;
+
+    /// Applies all buffered messages to the leaves.
+    void flush_all() override {
+        if (!this->root || !has_messages) return;
+        while (auto split = drain(*this->root)) {
+            grow_root(*split);
+        }
+        has_messages = false;
+    }
+
+    /// Are there messages that were not applied to the leaves yet?
+    bool has_buffered_messages() const { return has_messages; }
+
+    protected:
+    /// Were messages buffered since the last `flush_all()`?
+    bool has_messages = false;
+
+    /// Empties the message buffers of all inner nodes.
+    /// Inner nodes that are built by `BTree` do not initialize the buffer area.
+    void clear_buffers() {
+        if (this->root) clear_buffers(*this->root);
+    }
+
+    /// Empties the message buffers of the inner nodes of a subtree.
+    void clear_buffers(uint64_t page_id) {
+        auto& frame = this->pages.fix_page(page_id, true);
+        auto* node = reinterpret_cast<Node*>(frame.get_data());
+        if (node->is_leaf()) {
+            this->pages.unfix_page(frame, false);
+            return;
+        }
+        buffer_of(frame)->count = 0;
+        auto* inner = static_cast<InnerNode*>(node);
+        if (inner->level > 1) {
+            for (uint32_t i = 0; i < inner->count; ++i) {
+                clear_buffers(inner->child_id(i));
+            }
+        }
+        this->pages.unfix_page(frame, true);
+    }
+
+    /// Returns the message buffer of an inner node page.
+    static MessageBuffer* buffer_of(Frame &frame) {
+        return reinterpret_cast<MessageBuffer*>(frame.get_data() + kBufferOffset);
+    }
+
+    /// Adds a message to the root buffer, or applies it directly while the root is a leaf.
+    void put(const Message &message) {
+        if (!this->root) {
+            if (message.kind == MessageKind::Upsert) {
+                Base::insert(message.key, message.value);
+            }
+            return;
+        }
+
+        uint64_t root_id = *this->root;
+        Frame* frame = &this->pages.fix_page(root_id, true);
+        if (reinterpret_cast<Node*>(frame->get_data())->is_leaf()) {
+            this->pages.unfix_page(*frame, false);
+            if (message.kind == MessageKind::Upsert) {
+                Base::insert(message.key, message.value);
+            } else {
+                Base::erase(message.key);
+            }
+            if (*this->root != root_id) {
+                // The leaf was split, the new root starts with an empty buffer.
+                auto& root_frame = this->pages.fix_page(*this->root, true);
+                buffer_of(root_frame)->count = 0;
+                this->pages.unfix_page(root_frame, true);
+            }
+            return;
+        }
+
+        while (!buffer_of(*frame)->fits(message)) {
+            if (auto split = flush_once(*frame)) {
+                this->pages.unfix_page(*frame, true);
+                grow_root(*split);
+                frame = &this->pages.fix_page(*this->root, true);
+            }
+        }
+        buffer_of(*frame)->put(message);
+        has_messages = true;
+        this->pages.unfix_page(*frame, true);
+    }
+
+    /// Moves the messages for the child with the most pending messages one level down.
+    /// Stops early when the child has to be split, the remaining messages stay buffered.
+    /// @param[in] frame    The frame of the inner node.
+    /// @return             The split of the inner node, if it became full.
+    std::optional<Split> flush_once(Frame &frame) {
+        auto* node = reinterpret_cast<InnerNode*>(frame.get_data());
+        auto* buffer = buffer_of(frame);
+        if (buffer->count == 0) return {};
+
+        // Messages are sorted, so the messages of a child form a contiguous range.
+        uint32_t best_begin = 0, best_end = 0, best_slot = 0;
+        for (uint32_t begin = 0; begin < buffer->count;) {
+            uint32_t slot = node->child_slot(buffer->messages[begin].key);
+            uint32_t end = begin + 1;
+            while (end < buffer->count &&
+                   (slot == node->count - 1u || !(node->keys[slot] < buffer->messages[end].key))) {
+                ++end;
+            }
+            if (end - begin > best_end - best_begin) {
+                best_begin = begin;
+                best_end = end;
+                best_slot = slot;
+            }
+            begin = end;
+        }
+
+        auto& child_frame = this->pages.fix_page(node->child_id(best_slot), true);
+        auto [moved, child_split] = node->level == 1
+            ? apply_to_leaf(child_frame, buffer->messages + best_begin, best_end - best_begin)
+            : push_to_inner(child_frame, buffer->messages + best_begin, best_end - best_begin);
+        this->pages.unfix_page(child_frame, true);
+        buffer->remove(best_begin, best_begin + moved);
+
+        if (child_split) {
+            node->insert(child_split->separator, child_split->page_id);
+            if (node->count == InnerNode::kCapacity) {
+                return split_inner(frame);
+            }
+        }
+        return {};
+    }
+
+    /// Applies a batch of messages to a leaf.
+    /// @return             The number of applied messages and the split of the leaf,
+    ///                     if it had to be split to apply the next message.
+    std::pair<uint32_t, std::optional<Split>> apply_to_leaf(Frame &frame, const Message* messages, uint32_t n) {
+        auto* leaf = reinterpret_cast<LeafNode*>(frame.get_data());
+        for (uint32_t i = 0; i < n; ++i) {
+            const Message& message = messages[i];
+            if (message.kind == MessageKind::Delete) {
+                leaf->erase(message.key);
+                continue;
+            }
+            if (leaf->count == LeafNode::kCapacity && leaf->find(message.key) == leaf->count) {
+                uint64_t page_id = this->allocate_page();
+                auto& right_frame = this->pages.fix_page(page_id, true);
+                KeyT separator = leaf->split(reinterpret_cast<std::byte*>(right_frame.get_data()));
+                this->pages.unfix_page(right_frame, true);
+                return {i, Split{separator, page_id}};
+            }
+            leaf->insert(message.key, message.value);
+        }
+        return {n, std::nullopt};
+    }
+
+    /// Moves a batch of messages into the buffer of an inner node.
+    /// The inner node is flushed first if its buffer is full.
+    /// @return             The number of moved messages and the split of the inner
+    ///                     node, if flushing it made it full.
+    std::pair<uint32_t, std::optional<Split>> push_to_inner(Frame &frame, const Message* messages, uint32_t n) {
+        auto* buffer = buffer_of(frame);
+        if (buffer->count == kBufferCapacity) {
+            if (auto split = flush_once(frame)) {
+                return {0, split};
+            }
+        }
+        uint32_t i = 0;
+        for (; i < n && buffer->fits(messages[i]); ++i) {
+            buffer->put(messages[i]);
+        }
+        return {i, std::nullopt};
+    }
+
+    /// Splits a full inner node together with its message buffer.
+    Split split_inner(Frame &frame) {
+        auto* node = reinterpret_cast<InnerNode*>(frame.get_data());
+        auto* buffer = buffer_of(frame);
+        uint64_t page_id = this->allocate_page();
+        auto& right_frame = this->pages.fix_page(page_id, true);
+        KeyT separator = node->split(reinterpret_cast<std::byte*>(right_frame.get_data()));
+
+        auto* right_buffer = buffer_of(right_frame);
+        uint32_t keep = buffer->lower_bound(separator);
+        if (keep < buffer->count && buffer->messages[keep].key == separator) {
+            ++keep;
+        }
+        right_buffer->count = buffer->count - keep;
+        std::memcpy(right_buffer->messages, buffer->messages + keep, right_buffer->count * sizeof(Message));
+        buffer->count = keep;
+        this->pages.unfix_page(right_frame, true);
+        return {separator, page_id};
+    }
+
+    /// Replaces the root by a new root with the old root and its split as children.
+    void grow_root(const Split &split) {
+        uint64_t old_root = *this->root;
+        auto& old_frame = this->pages.fix_page(old_root, false);
+        uint16_t level = reinterpret_cast<Node*>(old_frame.get_data())->level;
+        this->pages.unfix_page(old_frame, false);
+
+        this->root = this->allocate_page();
+        auto& frame = this->pages.fix_page(*this->root, true);
+        auto* new_root = new (frame.get_data()) InnerNode();
+        new_root->level = level + 1;
+        new_root->insert(split.separator, old_root);
+        new_root->insert(split.separator, split.page_id);
+        buffer_of(frame)->count = 0;
+        this->pages.unfix_page(frame, true);
+    }
+
+    /// Applies all messages in the subtree of a node to the leaves.
+    /// @return             The split of the node, if it became full.
+    std::optional<Split> drain(uint64_t page_id) {
+        while (true) {
+            auto& frame = this->pages.fix_page(page_id, true);
+            auto* node = reinterpret_cast<Node*>(frame.get_data());
+            if (node->is_leaf()) {
+                this->pages.unfix_page(frame, false);
+                return {};
+            }
+
+            auto* inner = static_cast<InnerNode*>(node);
+            std::optional<Split> split;
+            bool changed = false;
+            if (buffer_of(frame)->count > 0) {
+                split = flush_once(frame);
+                changed = true;
+            } else if (inner->level > 1) {
+                for (uint32_t i = 0; i < inner->count; ++i) {
+                    if (auto child_split = drain(inner->child_id(i))) {
+                        inner->insert(child_split->separator, child_split->page_id);
+                        if (inner->count == InnerNode::kCapacity) {
+                            split = split_inner(frame);
+                        }
+                        changed = true;
+                        break;
+                    }
+                }
+            }
+            this->pages.unfix_page(frame, changed);
+            if (split || !changed) {
+                return split;
+            }
+        }
+    }
+};
+
+}  // namespace buzzdb
@@ -0,0 +1,219 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <type_traits>
+
+namespace buzzdb {
+
+/// Key layouts for the separators of the inner nodes.
+/// A layout provides a nested `Index<KeyT, Capacity>` that is embedded into every
+/// inner node next to the sorted separators. Writers rebuild the index with
+/// `rebuild(keys, count)` whenever they change the separators, while they hold
+/// the node exclusively, so searches only read the node and may run on pages
+/// that are fixed shared. A search on an index that was never built for the
+/// current separators falls back to the tree's search policy.
+
+/// Searches the sorted separators directly with the tree's search policy.
+struct SortedInnerLayout {
+    template<typename KeyT, uint32_t Capacity>
+    struct Index {
+        /// Nothing to build.
+        void rebuild(const KeyT*, uint32_t) {}
+
+        /// Get the index of the first key that is not less than the provided key.
+        /// @param[in] keys      The sorted keys.
+        /// @param[in] count     The number of keys.
+        /// @param[in] key       The key to be checked against.
+        template<typename SearchPolicyT>
+        uint32_t lower_bound(const KeyT* keys, uint32_t count, const KeyT& key) const {
+            return SearchPolicyT::lower_bound(keys, count, key);
+        }
+    };
+};
+
+/// Cache-line-blocked k-ary search over the separators.
+/// The sorted separators are cut into blocks of `kFanout` keys that fill one
+/// cache line. Every summary level stores the largest key of each block of the
+/// level below, until the top level fits into a single block. A search scans
+/// one block per level with a branch-free linear scan, so it touches one cache
+/// line per level instead of one per binary search probe.
+struct BlockedInnerLayout {
+    template<typename KeyT, uint32_t Capacity>
+    struct Index {
+        /// The number of keys in one block.
+        static constexpr uint32_t kFanout = sizeof(KeyT) <= 32 ? 64 / sizeof(KeyT) : 2;
+
+        /// The number of summary keys that are needed for `Capacity` keys.
+        static constexpr uint32_t summary_capacity() {
+            uint32_t total = 0;
+            for (uint32_t size = Capacity; size > kFanout;) {
+                size = (size + kFanout - 1) / kFanout;
+                total += size;
+            }
+            return total;
+        }
+
+        /// The summary levels, the lowest level first.
+        KeyT summary[summary_capacity() > 0 ? summary_capacity() : 1];
+        /// The number of keys the summary was built for.
+        uint16_t built_count;
+        /// Is the summary up to date?
+        bool valid = false;
+
+        /// Rebuilds the summary levels.
+        /// @param[in] keys      The sorted keys.
+        /// @param[in] count     The number of keys.
+        void rebuild(const KeyT* keys, uint32_t count) {
+            const KeyT* level = keys;
+            KeyT* next = summary;
+            for (uint32_t size = count; size > kFanout;) {
+                uint32_t blocks = (size + kFanout - 1) / kFanout;
+                for (uint32_t b = 0; b < blocks; ++b) {
+                    uint32_t last = (b + 1) * kFanout < size ? (b + 1) * kFanout : size;
+                    next[b] = level[last - 1];
+                }
+                level = next;
+                next += blocks;
+                size = blocks;
+            }
+            built_count = static_cast<uint16_t>(count);
+            valid = true;
+        }
+
+        /// Get the index of the first key that is not less than the provided key.
+        /// @param[in] keys      The sorted keys.
+        /// @param[in] count     The number of keys.
+        /// @param[in] key       The key to be checked against.
+        template<typename SearchPolicyT>
+        uint32_t lower_bound(const KeyT* keys, uint32_t count, const KeyT& key) const {
+            if (!valid || built_count != count) {
+                return SearchPolicyT::lower_bound(keys, count, key);
+            }
+
+            // Collect the start and size of every level, the keys are level 0.
+            const KeyT* levels[8];
+            uint32_t sizes[8];
+            uint32_t height = 0;
+            levels[0] = keys;
+            sizes[0] = count;
+            const KeyT* next = summary;
+            while (sizes[height] > kFanout) {
+                uint32_t blocks = (sizes[height] + kFanout - 1) / kFanout;
+                ++height;
+                levels[height] = next;
+                sizes[height] = blocks;
+                next += blocks;
+            }
+
+            // Scan one block per level, top-down.
+            uint32_t block = 0;
+            for (uint32_t l = height + 1; l-- > 0;) {
+                uint32_t begin = block * kFanout;
+                uint32_t end = begin + kFanout < sizes[l] ? begin + kFanout : sizes[l];
+                uint32_t position = begin;
+                for (uint32_t i = begin; i < end; ++i) {
+                    position += levels[l][i] < key;
+                }
+                if (position == end && end == sizes[l]) {
+                    return count;
+                }
+                block = position;
+            }
+            return block;
+        }
+    };
+};
+
+/// Learned routing for arithmetic keys.
+/// A linear model, fitted to the separators by least squares, predicts the
+/// position of a key. The largest error of the model on the separators bounds
+/// the error for every key in between, since the model is monotonic, so the
+/// search only has to look at a window of `2 * error + 2` separators around the
+/// prediction. Smooth key distributions lead to small windows. The model is
+/// retrained after every modification of the separators, e.g. after a split.
+struct LearnedInnerLayout {
+    template<typename KeyT, uint32_t Capacity>
+    struct Index {
+        static_assert(std::is_arithmetic_v<KeyT>, "learned routing needs arithmetic keys");
+
+        /// The predicted position of `keys[0] + d` is `slope * d + intercept`.
+        double slope;
+        /// The predicted position of `keys[0]`.
+        double intercept;
+        /// The largest distance between a predicted and a real position.
+        uint32_t error;
+        /// The number of keys the model was trained for.
+        uint16_t built_count;
+        /// Is the model up to date?
+        bool valid = false;
+
+        /// Predicts the position of a key.
+        /// @param[in] keys      The sorted keys.
+        /// @param[in] key       The key.
+        double predict(const KeyT* keys, const KeyT& key) const {
+            return slope * (static_cast<double>(key) - static_cast<double>(keys[0])) + intercept;
+        }
+
+        /// Fits the model to the keys.
+        /// @param[in] keys      The sorted keys.
+        /// @param[in] count     The number of keys.
+        void rebuild(const KeyT* keys, uint32_t count) {
+            slope = 0;
+            intercept = 0;
+            if (count > 1) {
+                double mean_x = 0;
+                double mean_y = (count - 1) / 2.0;
+                for (uint32_t i = 0; i < count; ++i) {
+                    mean_x += static_cast<double>(keys[i]) - static_cast<double>(keys[0]);
+                }
+                mean_x /= count;
+                double covariance = 0;
+                double variance = 0;
+                for (uint32_t i = 0; i < count; ++i) {
+                    double dx = static_cast<double>(keys[i]) - static_cast<double>(keys[0]) - mean_x;
+                    covariance += dx * (i - mean_y);
+                    variance += dx * dx;
+                }
+                slope = variance > 0 ? covariance / variance : 0;
+                intercept = mean_y - slope * mean_x;
+            }
+            double max_error = 0;
+            for (uint32_t i = 0; i < count; ++i) {
+                max_error = std::max(max_error, std::abs(predict(keys, keys[i]) - i));
+            }
+            error = static_cast<uint32_t>(std::ceil(max_error));
+            built_count = static_cast<uint16_t>(count);
+            valid = true;
+        }
+
+        /// Get the index of the first key that is not less than the provided key.
+        /// @param[in] keys      The sorted keys.
+        /// @param[in] count     The number of keys.
+        /// @param[in] key       The key to be checked against.
+        template<typename SearchPolicyT>
+        uint32_t lower_bound(const KeyT* keys, uint32_t count, const KeyT& key) const {
+            if (!valid || built_count != count) {
+                return SearchPolicyT::lower_bound(keys, count, key);
+            }
+            if (count == 0 || !(keys[0] < key)) return 0;
+            if (keys[count - 1] < key) return count;
+
+            // The key lies between two separators, both are predicted within the error.
+            double prediction = predict(keys, key);
+            double first = std::floor(prediction) - error - 1;
+            double last = std::ceil(prediction) + error + 1;
+            auto begin = static_cast<uint32_t>(std::clamp(first, 0.0, static_cast<double>(count)));
+            auto end = static_cast<uint32_t>(std::clamp(last, 0.0, static_cast<double>(count)));
+            uint32_t position = begin + SearchPolicyT::lower_bound(keys + begin, end - begin, key);
+            if ((position > 0 && !(keys[position - 1] < key)) || (position < count && keys[position] < key)) {
+                // Rounding errors moved the key out of the window.
+                return SearchPolicyT::lower_bound(keys, count, key);
+            }
+            return position;
+        }
+    };
+};
+
+}  // namespace buzzdb
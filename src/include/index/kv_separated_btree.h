@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+#include "buffer/buffer_manager.h"
+#include "index/btree.h"
+#include "storage/value_log.h"
+
+namespace buzzdb {
+
+/// A B-Tree with key/value separation for large values.
+/// The leaves only store the keys and a `ValueRef` into a value log that lives
+/// in its own segment, so the fan-out of the leaves and the amount of data that
+/// is moved by searches and splits do not depend on the size of the values.
+/// The remaining template parameters are forwarded to the underlying `BTree`.
+template<typename KeyT, typename ValueT, typename ComparatorT, size_t PageSize,
+         typename... PolicyTs>
+struct KVSeparatedBTree {
+    static_assert(sizeof(ValueT) <= PageSize, "values must fit into a page of the value log");
+
+    /// The tree that maps the keys to value references.
+    using Tree = BTree<KeyT, ValueRef, ComparatorT, PageSize, PolicyTs...>;
+
+    /// The index.
+    Tree tree;
+    /// The values.
+    ValueLog<ValueT> values;
+
+    /// Constructor.
+    /// @param[in] segment_id         Id of the segment of the tree.
+    /// @param[in] value_segment_id   Id of the segment of the value log.
+    /// @param[in] buffer_manager     The buffer manager that should be used.
+    KVSeparatedBTree(uint16_t segment_id, uint16_t value_segment_id, BufferManager &buffer_manager)
+        : tree(segment_id, buffer_manager), values(value_segment_id, buffer_manager) {}
+
+    /// Lookup an entry in the tree.
+    /// @param[in] key      The key that should be searched.
+    /// @return             The value, if the key was in the tree.
+    std::optional<ValueT> lookup(const KeyT &key) {
+        auto ref = tree.lookup(key);
+        if (!ref) {
+            return {};
+        }
+        return values.read(*ref);
+    }
+
+    /// Inserts a new entry into the tree.
+    /// The value is appended to the value log, an overwritten value remains
+    /// there as garbage.
+    /// @param[in] key      The key that should be inserted.
+    /// @param[in] value    The value that should be inserted.
+    void insert(const KeyT &key, const ValueT &value) {
+        tree.insert(key, values.append(value));
+    }
+
+    /// Erase an entry in the tree.
+    /// @param[in] key      The key that should be erased.
+    void erase(const KeyT &key) {
+        tree.erase(key);
+    }
+};
+
+}  // namespace buzzdb
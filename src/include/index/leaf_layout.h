@@ -0,0 +1,370 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+namespace buzzdb {
+
+/// Computes a 64 bit hash of a key.
+/// Keys that compare equal must hash equally, so keys that are not integers are
+/// hashed by their bytes and must not have several representations of a value
+/// (like -0.0 and 0.0) or padding, e.g. `NormalizedKey`.
+/// @param[in] key       The key.
+template<typename KeyT>
+uint64_t key_hash(const KeyT& key) {
+    static_assert(std::is_integral_v<KeyT> || std::has_unique_object_representations_v<KeyT>,
+                  "keys are hashed by their bytes, equal keys must have equal bytes");
+    if constexpr (std::is_integral_v<KeyT>) {
+        return static_cast<uint64_t>(key) * 0x9E3779B97F4A7C15ull;
+    } else {
+        // FNV-1a over the key bytes
+        auto bytes = reinterpret_cast<const unsigned char*>(&key);
+        uint64_t hash = 0xcbf29ce484222325ull;
+        for (size_t i = 0; i < sizeof(KeyT); ++i) {
+            hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+        }
+        return hash;
+    }
+}
+
+/// Computes a one byte fingerprint of a key.
+/// @param[in] key       The key.
+template<typename KeyT>
+uint8_t key_fingerprint(const KeyT& key) {
+    return static_cast<uint8_t>(key_hash(key) >> 56);
+}
+
+/// Layouts for the entries of the leaf nodes.
+/// A layout provides a nested `Storage<KeyT, ValueT, Capacity>` with slot accessors
+/// (`key`, `value`, `set`), bulk moves (`move`, `copy_to`) and the two searches
+/// `lower_bound` (first key not less than the provided key) and `find` (slot of
+/// an equal key or `count`). The entries are always kept sorted by key. The
+/// searches must not write to the storage: leaves are searched while they are
+/// fixed shared, by concurrent readers and on pages that snapshots share.
+
+/// Struct of arrays: all keys, followed by all values.
+/// Searches only touch keys, but a hit needs another cache miss for the value.
+struct SoALeafLayout {
+    template<typename KeyT, typename ValueT, uint32_t Capacity>
+    struct Storage {
+        /// Are the keys and values stored in separate `keys` and `values` arrays?
+        static constexpr bool kColumnar = true;
+        /// Does the storage adapt to the point lookups of the leaf, see `AdaptiveLeafLayout`?
+        static constexpr bool kAdaptive = false;
+
+        /// The keys.
+        KeyT keys[Capacity];
+        /// The values.
+        ValueT values[Capacity];
+
+        /// Slot accessors.
+        const KeyT& key(uint32_t slot) const { return keys[slot]; }
+        ValueT& value(uint32_t slot) { return values[slot]; }
+        const ValueT& value(uint32_t slot) const { return values[slot]; }
+
+        /// Stores an entry in a slot.
+        void set(uint32_t slot, const KeyT& key, const ValueT& value) {
+            keys[slot] = key;
+            values[slot] = value;
+        }
+
+        /// Moves `n` entries from slot `src` to slot `dst`, the ranges may overlap.
+        void move(uint32_t dst, uint32_t src, uint32_t n) {
+            std::memmove(keys + dst, keys + src, n * sizeof(KeyT));
+            std::memmove(values + dst, values + src, n * sizeof(ValueT));
+        }
+
+        /// Copies `n` entries starting at slot `src` to slot `dst` of another storage.
+        void copy_to(Storage& other, uint32_t dst, uint32_t src, uint32_t n) const {
+            std::memcpy(other.keys + dst, keys + src, n * sizeof(KeyT));
+            std::memcpy(other.values + dst, values + src, n * sizeof(ValueT));
+        }
+
+        /// Get the slot of the first key that is not less than the provided key.
+        template<typename SearchPolicyT>
+        uint32_t lower_bound(uint32_t count, const KeyT& key) const {
+            return SearchPolicyT::lower_bound(keys, count, key);
+        }
+
+        /// Get the slot of the provided key, or `count` if it is not stored.
+        template<typename SearchPolicyT>
+        uint32_t find(uint32_t count, const KeyT& key) const {
+            uint32_t slot = lower_bound<SearchPolicyT>(count, key);
+            return (slot < count && keys[slot] == key) ? slot : count;
+        }
+    };
+};
+
+/// Interleaved key/value pairs.
+/// A point lookup finds the value in the same cache line as its key, at the
+/// price of a search that strides over the values. The search policy is not
+/// used since the keys are not contiguous, the pairs are binary searched.
+struct InterleavedLeafLayout {
+    template<typename KeyT, typename ValueT, uint32_t Capacity>
+    struct Storage {
+        /// Are the keys and values stored in separate `keys` and `values` arrays?
+        static constexpr bool kColumnar = false;
+        /// Does the storage adapt to the point lookups of the leaf, see `AdaptiveLeafLayout`?
+        static constexpr bool kAdaptive = false;
+
+        struct Entry {
+            KeyT key;
+            ValueT value;
+        };
+
+        /// The entries.
+        Entry entries[Capacity];
+
+        /// Slot accessors.
+        const KeyT& key(uint32_t slot) const { return entries[slot].key; }
+        ValueT& value(uint32_t slot) { return entries[slot].value; }
+        const ValueT& value(uint32_t slot) const { return entries[slot].value; }
+
+        /// Stores an entry in a slot.
+        void set(uint32_t slot, const KeyT& key, const ValueT& value) {
+            entries[slot].key = key;
+            entries[slot].value = value;
+        }
+
+        /// Moves `n` entries from slot `src` to slot `dst`, the ranges may overlap.
+        void move(uint32_t dst, uint32_t src, uint32_t n) {
+            std::memmove(entries + dst, entries + src, n * sizeof(Entry));
+        }
+
+        /// Copies `n` entries starting at slot `src` to slot `dst` of another storage.
+        void copy_to(Storage& other, uint32_t dst, uint32_t src, uint32_t n) const {
+            std::memcpy(other.entries + dst, entries + src, n * sizeof(Entry));
+        }
+
+        /// Get the slot of the first key that is not less than the provided key.
+        template<typename SearchPolicyT>
+        uint32_t lower_bound(uint32_t count, const KeyT& key) const {
+            uint32_t start = 0;
+            uint32_t end = count;
+            while (start < end) {
+                uint32_t center = start + (end - start) / 2;
+                if (entries[center].key < key) {
+                    start = center + 1;
+                } else {
+                    end = center;
+                }
+            }
+            return start;
+        }
+
+        /// Get the slot of the provided key, or `count` if it is not stored.
+        template<typename SearchPolicyT>
+        uint32_t find(uint32_t count, const KeyT& key) const {
+            uint32_t slot = lower_bound<SearchPolicyT>(count, key);
+            return (slot < count && entries[slot].key == key) ? slot : count;
+        }
+    };
+};
+
+/// Struct of arrays with an additional one byte fingerprint per key.
+/// Point lookups compare the fingerprints of 32 slots at a time (a loop the
+/// compiler vectorizes) and only compare the full keys of the candidates,
+/// range searches use the sorted keys as usual.
+struct FingerprintLeafLayout {
+    template<typename KeyT, typename ValueT, uint32_t Capacity>
+    struct Storage {
+        /// Are the keys and values stored in separate `keys` and `values` arrays?
+        static constexpr bool kColumnar = true;
+        /// Does the storage adapt to the point lookups of the leaf, see `AdaptiveLeafLayout`?
+        static constexpr bool kAdaptive = false;
+
+        /// The keys.
+        KeyT keys[Capacity];
+        /// The values.
+        ValueT values[Capacity];
+        /// The fingerprints of the keys.
+        uint8_t fingerprints[Capacity];
+
+        /// Slot accessors.
+        const KeyT& key(uint32_t slot) const { return keys[slot]; }
+        ValueT& value(uint32_t slot) { return values[slot]; }
+        const ValueT& value(uint32_t slot) const { return values[slot]; }
+
+        /// Stores an entry in a slot.
+        void set(uint32_t slot, const KeyT& key, const ValueT& value) {
+            keys[slot] = key;
+            values[slot] = value;
+            fingerprints[slot] = key_fingerprint(key);
+        }
+
+        /// Moves `n` entries from slot `src` to slot `dst`, the ranges may overlap.
+        void move(uint32_t dst, uint32_t src, uint32_t n) {
+            std::memmove(keys + dst, keys + src, n * sizeof(KeyT));
+            std::memmove(values + dst, values + src, n * sizeof(ValueT));
+            std::memmove(fingerprints + dst, fingerprints + src, n);
+        }
+
+        /// Copies `n` entries starting at slot `src` to slot `dst` of another storage.
+        void copy_to(Storage& other, uint32_t dst, uint32_t src, uint32_t n) const {
+            std::memcpy(other.keys + dst, keys + src, n * sizeof(KeyT));
+            std::memcpy(other.values + dst, values + src, n * sizeof(ValueT));
+            std::memcpy(other.fingerprints + dst, fingerprints + src, n);
+        }
+
+        /// Get the slot of the first key that is not less than the provided key.
+        template<typename SearchPolicyT>
+        uint32_t lower_bound(uint32_t count, const KeyT& key) const {
+            return SearchPolicyT::lower_bound(keys, count, key);
+        }
+
+        /// Get the slot of the provided key, or `count` if it is not stored.
+        template<typename SearchPolicyT>
+        uint32_t find(uint32_t count, const KeyT& key) const {
+            uint8_t fingerprint = key_fingerprint(key);
+            for (uint32_t base = 0; base < count; base += 32) {
+                uint32_t end = base + 32 < count ? base + 32 : count;
+                uint32_t candidates = 0;
+                for (uint32_t i = base; i < end; ++i) {
+                    candidates |= static_cast<uint32_t>(fingerprints[i] == fingerprint) << (i - base);
+                }
+                while (candidates != 0) {
+                    uint32_t slot = base + static_cast<uint32_t>(__builtin_ctz(candidates));
+                    if (keys[slot] == key) {
+                        return slot;
+                    }
+                    candidates &= candidates - 1;
+                }
+            }
+            return count;
+        }
+    };
+};
+
+/// Struct of arrays that adds a hash index for leaves that mostly serve point lookups.
+/// The tree counts the point lookups of every leaf outside of the page, since
+/// searches must not write to it. When a leaf is modified after at least
+/// `kHashThreshold` point lookups since its previous modification, the writer
+/// builds an open-addressed table that maps keys to their slots, and point
+/// lookups need a single probe in most cases. Otherwise a modification drops
+/// the table. The entries themselves stay sorted, so range searches are not
+/// affected by the table.
+struct AdaptiveLeafLayout {
+    template<typename KeyT, typename ValueT, uint32_t Capacity>
+    struct Storage {
+        static_assert(Capacity < 255, "the table stores slots as bytes");
+
+        /// Are the keys and values stored in separate `keys` and `values` arrays?
+        static constexpr bool kColumnar = true;
+        /// Does the storage adapt to the point lookups of the leaf?
+        static constexpr bool kAdaptive = true;
+
+        /// The number of point lookups after which the table is built.
+        static constexpr uint16_t kHashThreshold = 16;
+
+        /// The number of table entries, a power of two with a load factor of at most 2/3.
+        static constexpr uint32_t table_size() {
+            uint32_t size = 1;
+            while (size * 2 < Capacity * 3) size *= 2;
+            return size;
+        }
+
+        /// The number of bits of a table position.
+        static constexpr uint32_t table_bits() {
+            uint32_t bits = 0;
+            while ((1u << bits) < table_size()) ++bits;
+            return bits;
+        }
+
+        /// The keys.
+        KeyT keys[Capacity];
+        /// The values.
+        ValueT values[Capacity];
+        /// The table, every entry is a slot plus one or 0 if it is empty.
+        uint8_t table[table_size()];
+        /// Is the table up to date?
+        bool hashed = false;
+
+        /// Slot accessors.
+        const KeyT& key(uint32_t slot) const { return keys[slot]; }
+        ValueT& value(uint32_t slot) { return values[slot]; }
+        const ValueT& value(uint32_t slot) const { return values[slot]; }
+
+        /// Switches back to sorted-only access.
+        void unhash() { hashed = false; }
+
+        /// Builds or drops the table after a modification of the leaf.
+        /// Must be called while the leaf is fixed exclusively.
+        /// @param[in] count          The number of entries.
+        /// @param[in] point_lookups  The number of point lookups since the
+        ///                           previous modification.
+        void adapt(uint32_t count, uint32_t point_lookups) {
+            if (point_lookups < kHashThreshold) {
+                unhash();
+            } else if (!hashed) {
+                build_table(count);
+            }
+        }
+
+        /// Stores an entry in a slot.
+        void set(uint32_t slot, const KeyT& key, const ValueT& value) {
+            keys[slot] = key;
+            values[slot] = value;
+            unhash();
+        }
+
+        /// Moves `n` entries from slot `src` to slot `dst`, the ranges may overlap.
+        void move(uint32_t dst, uint32_t src, uint32_t n) {
+            std::memmove(keys + dst, keys + src, n * sizeof(KeyT));
+            std::memmove(values + dst, values + src, n * sizeof(ValueT));
+            unhash();
+        }
+
+        /// Copies `n` entries starting at slot `src` to slot `dst` of another storage.
+        void copy_to(Storage& other, uint32_t dst, uint32_t src, uint32_t n) {
+            std::memcpy(other.keys + dst, keys + src, n * sizeof(KeyT));
+            std::memcpy(other.values + dst, values + src, n * sizeof(ValueT));
+            unhash();
+            other.unhash();
+        }
+
+        /// Returns the first table position for a key.
+        static uint32_t home(const KeyT& key) {
+            return static_cast<uint32_t>(key_hash(key) >> (64 - table_bits()));
+        }
+
+        /// Builds the table.
+        void build_table(uint32_t count) {
+            std::memset(table, 0, sizeof(table));
+            for (uint32_t slot = 0; slot < count; ++slot) {
+                uint32_t position = home(keys[slot]);
+                while (table[position] != 0) {
+                    position = (position + 1) & (table_size() - 1);
+                }
+                table[position] = static_cast<uint8_t>(slot + 1);
+            }
+            hashed = true;
+        }
+
+        /// Get the slot of the first key that is not less than the provided key.
+        template<typename SearchPolicyT>
+        uint32_t lower_bound(uint32_t count, const KeyT& key) const {
+            return SearchPolicyT::lower_bound(keys, count, key);
+        }
+
+        /// Get the slot of the provided key, or `count` if it is not stored.
+        template<typename SearchPolicyT>
+        uint32_t find(uint32_t count, const KeyT& key) const {
+            if (hashed) {
+                for (uint32_t position = home(key); table[position] != 0;
+                     position = (position + 1) & (table_size() - 1)) {
+                    uint32_t slot = table[position] - 1u;
+                    if (keys[slot] == key) {
+                        return slot;
+                    }
+                }
+                return count;
+            }
+            uint32_t slot = SearchPolicyT::lower_bound(keys, count, key);
+            return (slot < count && keys[slot] == key) ? slot : count;
+        }
+    };
+};
+
+}  // namespace buzzdb
@@ -0,0 +1,211 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include "index/leaf_layout.h"
+
+namespace buzzdb {
+
+/// A bounded cache of the values of recently looked up keys.
+/// The cache is split into partitions with their own latch, so concurrent
+/// lookups of different keys rarely contend. Every partition replaces its
+/// entries with the CLOCK algorithm: a hit sets the reference bit of an entry,
+/// the clock hand clears the bits and evicts the first entry without one. New
+/// entries are admitted without the bit, so keys that are looked up only once
+/// are the first to go, and hot keys survive a sweep over cold ones.
+template<typename KeyT, typename ValueT>
+class LookupCache {
+    public:
+    /// The number of partitions.
+    static constexpr size_t kPartitionCount = 16;
+
+    /// The hit and miss counters.
+    struct Stats {
+        /// The number of lookups that found their key.
+        uint64_t hits;
+        /// The number of lookups that did not find their key.
+        uint64_t misses;
+
+        /// Returns the share of lookups that found their key.
+        double hit_rate() const {
+            return hits + misses == 0 ? 0.0 : static_cast<double>(hits) / (hits + misses);
+        }
+    };
+
+    /// Constructor.
+    /// @param[in] capacity     The maximum number of cached entries.
+    explicit LookupCache(size_t capacity)
+        : partition_capacity(std::max<size_t>((capacity + kPartitionCount - 1) / kPartitionCount, 1)) {}
+
+    /// Looks up the cached value of a key and marks it as referenced.
+    /// @param[in] key      The key.
+    std::optional<ValueT> find(const KeyT &key) {
+        auto& partition = partition_of(key);
+        std::lock_guard<std::mutex> guard(partition.mutex);
+        auto it = partition.slots.find(key);
+        if (it == partition.slots.end()) {
+            misses.fetch_add(1, std::memory_order_relaxed);
+            return {};
+        }
+        hits.fetch_add(1, std::memory_order_relaxed);
+        auto& entry = partition.entries[it->second];
+        entry.referenced = true;
+        return entry.value;
+    }
+
+    /// Adds the value of a key that was looked up, evicting another entry if
+    /// the partition is full.
+    /// @param[in] key      The key.
+    /// @param[in] value    The value of the key.
+    void admit(const KeyT &key, const ValueT &value) {
+        auto& partition = partition_of(key);
+        std::lock_guard<std::mutex> guard(partition.mutex);
+        auto it = partition.slots.find(key);
+        if (it != partition.slots.end()) {
+            partition.entries[it->second].value = value;
+            return;
+        }
+        if (partition.entries.size() < partition_capacity) {
+            partition.slots.emplace(key, static_cast<uint32_t>(partition.entries.size()));
+            partition.entries.push_back({key, value, false});
+            return;
+        }
+        auto& entries = partition.entries;
+        while (entries[partition.hand].referenced) {
+            entries[partition.hand].referenced = false;
+            partition.hand = (partition.hand + 1) % entries.size();
+        }
+        partition.slots.erase(entries[partition.hand].key);
+        partition.slots.emplace(key, static_cast<uint32_t>(partition.hand));
+        entries[partition.hand] = {key, value, false};
+        partition.hand = (partition.hand + 1) % entries.size();
+    }
+
+    /// Replaces the value of a key if it is cached.
+    /// @param[in] key      The key.
+    /// @param[in] value    The new value of the key.
+    void update(const KeyT &key, const ValueT &value) {
+        auto& partition = partition_of(key);
+        std::lock_guard<std::mutex> guard(partition.mutex);
+        auto it = partition.slots.find(key);
+        if (it != partition.slots.end()) {
+            partition.entries[it->second].value = value;
+        }
+    }
+
+    /// Removes a key.
+    /// @param[in] key      The key.
+    void erase(const KeyT &key) {
+        auto& partition = partition_of(key);
+        std::lock_guard<std::mutex> guard(partition.mutex);
+        auto it = partition.slots.find(key);
+        if (it == partition.slots.end()) return;
+        uint32_t slot = it->second;
+        partition.slots.erase(it);
+        remove_slot(partition, slot);
+    }
+
+    /// Removes all keys in [lo, hi].
+    /// @param[in] lo       The smallest key that should be removed.
+    /// @param[in] hi       The largest key that should be removed.
+    void erase_range(const KeyT &lo, const KeyT &hi) {
+        for (auto& partition : partitions) {
+            std::lock_guard<std::mutex> guard(partition.mutex);
+            for (size_t slot = partition.entries.size(); slot-- > 0;) {
+                const KeyT& key = partition.entries[slot].key;
+                if (!(key < lo) && !(hi < key)) {
+                    partition.slots.erase(key);
+                    remove_slot(partition, static_cast<uint32_t>(slot));
+                }
+            }
+        }
+    }
+
+    /// Removes all keys.
+    void clear() {
+        for (auto& partition : partitions) {
+            std::lock_guard<std::mutex> guard(partition.mutex);
+            partition.entries.clear();
+            partition.slots.clear();
+            partition.hand = 0;
+        }
+    }
+
+    /// Returns the number of cached keys.
+    size_t size() {
+        size_t count = 0;
+        for (auto& partition : partitions) {
+            std::lock_guard<std::mutex> guard(partition.mutex);
+            count += partition.entries.size();
+        }
+        return count;
+    }
+
+    /// Returns the counters since the cache was created.
+    Stats stats() const {
+        return {hits.load(std::memory_order_relaxed), misses.load(std::memory_order_relaxed)};
+    }
+
+    protected:
+    /// A cached entry.
+    struct Entry {
+        /// The key.
+        KeyT key;
+        /// The value.
+        ValueT value;
+        /// Was the entry hit since the clock hand passed it?
+        bool referenced;
+    };
+
+    /// Hashes keys with `key_hash()`, so any key type of the tree can be cached.
+    struct KeyHasher {
+        size_t operator()(const KeyT &key) const { return static_cast<size_t>(key_hash(key)); }
+    };
+
+    /// A partition of the cache.
+    struct alignas(64) Partition {
+        /// Protects the partition.
+        std::mutex mutex;
+        /// The entries in the order of the clock.
+        std::vector<Entry> entries;
+        /// The slot of every cached key in `entries`.
+        std::unordered_map<KeyT, uint32_t, KeyHasher> slots;
+        /// The clock hand, the next entry that is considered for eviction.
+        size_t hand = 0;
+    };
+
+    /// Returns the partition that is responsible for a key.
+    Partition& partition_of(const KeyT &key) {
+        return partitions[(key_hash(key) >> 32) % kPartitionCount];
+    }
+
+    /// Removes an entry whose key was already removed from `slots` by moving
+    /// the last entry into its slot.
+    static void remove_slot(Partition &partition, uint32_t slot) {
+        auto& entries = partition.entries;
+        if (slot + 1 != entries.size()) {
+            entries[slot] = entries.back();
+            partition.slots[entries[slot].key] = slot;
+        }
+        entries.pop_back();
+        if (partition.hand >= entries.size()) partition.hand = 0;
+    }
+
+    /// The maximum number of entries per partition.
+    size_t partition_capacity;
+    /// The partitions.
+    Partition partitions[kPartitionCount];
+    /// The number of lookups that found their key.
+    std::atomic<uint64_t> hits{0};
+    /// The number of lookups that did not find their key.
+    std::atomic<uint64_t> misses{0};
+};
+
+}  // namespace buzzdb
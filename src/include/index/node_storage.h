@@ -0,0 +1,219 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+#include "buffer/buffer_manager.h"
+
+namespace buzzdb {
+
+/// Storage policies for the nodes of the B-Tree.
+/// A policy provides a nested `Pages<PageSize>` that is constructed with the
+/// segment id and the buffer manager of the tree. It maps the page ids that
+/// the tree allocates to frames with `fix_page(page_id, exclusive)` and
+/// `unfix_page(frame, is_dirty)`, a frame exposes the page with `get_data()`.
+/// The child references of inner nodes are read with `page_id_of(ref)`, which
+/// returns the page id of the child, and followed with `fix_child(ref, exclusive)`
+/// while the parent is fixed. A frame returned by `fix_child()` is unfixed with
+/// `unfix_page()` like one returned by `fix_page()`. Readers inside an epoch of
+/// the buffer manager may access pages with `read_page(page_id)` instead, which
+/// does not fix them and needs no unfix.
+
+/// The pages are fixed in the buffer manager.
+/// Trees may be larger than memory, but every node access probes the page table.
+struct BufferManagerStorage {
+    template<size_t PageSize>
+    class Pages {
+        public:
+        /// The frame of a fixed page.
+        using Frame = BufferFrame;
+
+        /// Constructor.
+        Pages(uint16_t, BufferManager &buffer_manager)
+            : buffer_manager(buffer_manager) {}
+
+        /// Fixes a page, see `BufferManager::fix_page()`.
+        Frame& fix_page(uint64_t page_id, bool exclusive) {
+            return buffer_manager.fix_page(page_id, exclusive);
+        }
+
+        /// Unfixes a page, see `BufferManager::unfix_page()`.
+        void unfix_page(Frame &frame, bool is_dirty) {
+            buffer_manager.unfix_page(frame, is_dirty);
+        }
+
+        /// Returns the frame of a page without fixing it, see `BufferManager::read_page()`.
+        Frame& read_page(uint64_t page_id) {
+            return buffer_manager.read_page(page_id);
+        }
+
+        /// Are child references ever swizzled?
+        static constexpr bool kSwizzling = false;
+
+        /// Returns the page id of a child reference.
+        static uint64_t page_id_of(uint64_t ref) { return ref; }
+
+        /// Fixes the child of a child reference.
+        Frame& fix_child(uint64_t &ref, bool exclusive) {
+            return fix_page(ref, exclusive);
+        }
+
+        protected:
+        /// The buffer manager.
+        BufferManager& buffer_manager;
+    };
+};
+
+/// The pages live in an arena in memory for the lifetime of the tree.
+/// The segment page id is an offset into the arena: its high bits select a
+/// chunk of `kPagesPerChunk` cache line aligned pages from a fixed directory,
+/// its low bits the page in the chunk. Fixing a page is therefore two loads,
+/// without a page table probe, latch or pin count, and unfixing does nothing.
+/// Chunks are allocated on the first access to one of their pages.
+struct InMemoryStorage {
+    template<size_t PageSize>
+    class Pages {
+        public:
+        /// A page, it is its own frame.
+        struct alignas(64) Frame {
+            /// The content of the page.
+            char data[PageSize];
+
+            /// Returns a pointer to the page's data.
+            char* get_data() { return data; }
+        };
+
+        /// The number of pages per chunk.
+        static constexpr uint64_t kPagesPerChunk = 256;
+        /// The maximum number of chunks.
+        static constexpr uint64_t kMaxChunks = 1 << 14;
+
+        /// Constructor.
+        Pages(uint16_t, BufferManager &)
+            : chunks(std::make_unique<std::atomic<Frame*>[]>(kMaxChunks)) {}
+
+        Pages(const Pages&) = delete;
+        Pages& operator=(const Pages&) = delete;
+
+        /// Destructor.
+        /// Frees the arena.
+        ~Pages() {
+            for (uint64_t i = 0; i < kMaxChunks; ++i) {
+                delete[] chunks[i].load();
+            }
+        }
+
+        /// Returns the frame of a page.
+        /// Throws `buffer_full_error` if the page lies beyond the arena.
+        Frame& fix_page(uint64_t page_id, bool) {
+            uint64_t local = BufferManager::get_segment_page_id(page_id);
+            uint64_t chunk = local / kPagesPerChunk;
+            if (chunk >= kMaxChunks) throw buffer_full_error{};
+            Frame* frames = chunks[chunk].load(std::memory_order_acquire);
+            if (!frames) frames = allocate_chunk(chunk);
+            return frames[local % kPagesPerChunk];
+        }
+
+        /// Nothing to do, the pages are never evicted.
+        void unfix_page(Frame &, bool) {}
+
+        /// Returns the frame of a page, fixing it is free anyway.
+        Frame& read_page(uint64_t page_id) {
+            return fix_page(page_id, false);
+        }
+
+        /// Are child references ever swizzled?
+        static constexpr bool kSwizzling = false;
+
+        /// Returns the page id of a child reference.
+        static uint64_t page_id_of(uint64_t ref) { return ref; }
+
+        /// Fixes the child of a child reference.
+        Frame& fix_child(uint64_t &ref, bool exclusive) {
+            return fix_page(ref, exclusive);
+        }
+
+        protected:
+        /// Allocates a chunk of zeroed pages unless another thread was faster.
+        Frame* allocate_chunk(uint64_t chunk) {
+            std::lock_guard<std::mutex> guard(allocation_mutex);
+            Frame* frames = chunks[chunk].load(std::memory_order_relaxed);
+            if (!frames) {
+                frames = new Frame[kPagesPerChunk]();
+                chunks[chunk].store(frames, std::memory_order_release);
+            }
+            return frames;
+        }
+
+        /// The chunks, nullptr until a page of the chunk is accessed.
+        std::unique_ptr<std::atomic<Frame*>[]> chunks;
+        /// Serializes the allocation of chunks.
+        std::mutex allocation_mutex;
+    };
+};
+
+/// The pages are fixed in the buffer manager, and the child references that
+/// are followed are swizzled: the page id is replaced by the address of the
+/// frame, tagged with the most significant bit. Following a swizzled reference
+/// skips the page table. The buffer manager calls the eviction handler of the
+/// tree before it evicts a frame, which unswizzles the reference in the parent
+/// (see `BTree::unswizzle_parent()`), so cold pages stay evictable. The segment
+/// ids of such trees must not use the most significant bit.
+struct SwizzlingStorage {
+    template<size_t PageSize>
+    class Pages : public BufferManagerStorage::Pages<PageSize> {
+        public:
+        using Frame = BufferFrame;
+
+        /// The tag of a swizzled reference.
+        static constexpr uint64_t kSwizzledTag = 1ull << 63;
+
+        /// Constructor.
+        Pages(uint16_t segment_id, BufferManager &buffer_manager)
+            : BufferManagerStorage::Pages<PageSize>(segment_id, buffer_manager) {}
+
+        /// Are child references ever swizzled?
+        static constexpr bool kSwizzling = true;
+
+        /// Is a child reference swizzled?
+        static bool is_swizzled(uint64_t ref) { return ref & kSwizzledTag; }
+
+        /// Returns the swizzled reference of a frame.
+        static uint64_t swizzled(Frame &frame) {
+            return reinterpret_cast<uint64_t>(&frame) | kSwizzledTag;
+        }
+
+        /// Returns the page id of a child reference.
+        static uint64_t page_id_of(uint64_t ref) {
+            return is_swizzled(ref) ? reinterpret_cast<Frame*>(ref & ~kSwizzledTag)->get_page_id() : ref;
+        }
+
+        /// Fixes the child of a child reference and swizzles the reference.
+        /// A swizzled child is fixed without probing the page table, but it is
+        /// pinned and latched like any other page. The caller must be inside an
+        /// epoch of the buffer manager: a concurrent eviction may unswizzle the
+        /// reference and remove the frame after it was read, the frame then
+        /// stays allocated until the epoch is exited, and the child is fixed
+        /// through the page table instead (see `BufferManager::try_fix_frame()`).
+        /// Concurrent readers and the eviction handler may swizzle or unswizzle
+        /// the same reference, so it is accessed atomically.
+        Frame& fix_child(uint64_t &ref, bool exclusive) {
+            uint64_t current = __atomic_load_n(&ref, __ATOMIC_ACQUIRE);
+            if (is_swizzled(current)) {
+                auto* child = reinterpret_cast<Frame*>(current & ~kSwizzledTag);
+                if (auto* frame = this->buffer_manager.try_fix_frame(*child, exclusive)) {
+                    return *frame;
+                }
+                current = child->get_page_id();
+            }
+            auto& frame = this->fix_page(current, exclusive);
+            __atomic_store_n(&ref, swizzled(frame), __ATOMIC_RELEASE);
+            return frame;
+        }
+    };
+};
+
+}  // namespace buzzdb
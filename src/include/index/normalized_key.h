@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string_view>
+#include <type_traits>
+
+namespace buzzdb {
+
+/// A fixed-size key whose byte-wise order is the order of the encoded fields.
+/// Keys are compared with a single `memcmp` instead of a comparison per field,
+/// see `KeyEncoder`. The unused tail is zero.
+template<size_t Size>
+struct NormalizedKey {
+    /// The encoded fields.
+    uint8_t bytes[Size] = {};
+
+    friend bool operator==(const NormalizedKey &a, const NormalizedKey &b) {
+        return std::memcmp(a.bytes, b.bytes, Size) == 0;
+    }
+    friend bool operator!=(const NormalizedKey &a, const NormalizedKey &b) { return !(a == b); }
+    friend bool operator<(const NormalizedKey &a, const NormalizedKey &b) {
+        return std::memcmp(a.bytes, b.bytes, Size) < 0;
+    }
+    friend bool operator>(const NormalizedKey &a, const NormalizedKey &b) { return b < a; }
+    friend bool operator<=(const NormalizedKey &a, const NormalizedKey &b) { return !(b < a); }
+    friend bool operator>=(const NormalizedKey &a, const NormalizedKey &b) { return !(a < b); }
+};
+
+/// The order of a field within a normalized key.
+enum class SortOrder : uint8_t { Ascending, Descending };
+
+/// Encodes a tuple of fields into a `NormalizedKey`, field by field.
+/// - Integers are stored big-endian, the sign bit of signed integers is
+///   flipped so that negative values come first.
+/// - Floating point numbers get their sign bit flipped, negative numbers all
+///   their bits, so that the bit patterns sort like the numbers.
+/// - Strings are terminated by 0x00 0x00, a 0x00 byte inside a string is
+///   escaped as 0x00 0xFF. A string therefore sorts before its extensions,
+///   and the fields after it do not influence its order.
+/// - All bytes of a descending field are inverted.
+/// Throws `std::length_error` if the fields do not fit into the key.
+template<size_t Size>
+class KeyEncoder {
+    public:
+    /// Appends an integer field.
+    /// @param[in] value    The value.
+    /// @param[in] order    The order of the field.
+    template<typename IntT>
+    KeyEncoder& add_integer(IntT value, SortOrder order = SortOrder::Ascending) {
+        static_assert(std::is_integral_v<IntT>, "integer fields must have an integral type");
+        using UnsignedT = std::make_unsigned_t<IntT>;
+        auto bits = static_cast<UnsignedT>(value);
+        if constexpr (std::is_signed_v<IntT>) {
+            bits ^= UnsignedT{1} << (sizeof(IntT) * 8 - 1);
+        }
+        for (size_t i = sizeof(IntT); i-- > 0;) {
+            put(static_cast<uint8_t>(bits >> (i * 8)), order);
+        }
+        return *this;
+    }
+
+    /// Appends a floating point field, NaNs are not supported.
+    /// @param[in] value    The value.
+    /// @param[in] order    The order of the field.
+    KeyEncoder& add_double(double value, SortOrder order = SortOrder::Ascending) {
+        // -0.0 and 0.0 are equal, they get the same encoding.
+        if (value == 0.0) value = 0.0;
+        uint64_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        bits = (bits >> 63) ? ~bits : bits | (1ull << 63);
+        for (size_t i = sizeof(bits); i-- > 0;) {
+            put(static_cast<uint8_t>(bits >> (i * 8)), order);
+        }
+        return *this;
+    }
+
+    /// Appends a string field.
+    /// @param[in] value    The value, may contain 0x00 bytes.
+    /// @param[in] order    The order of the field.
+    KeyEncoder& add_string(std::string_view value, SortOrder order = SortOrder::Ascending) {
+        for (char c : value) {
+            put(static_cast<uint8_t>(c), order);
+            if (c == '\0') put(0xFF, order);
+        }
+        put(0x00, order);
+        put(0x00, order);
+        return *this;
+    }
+
+    /// Returns the number of bytes that are used.
+    size_t size() const { return length; }
+
+    /// Returns the key.
+    const NormalizedKey<Size>& key() const { return encoded; }
+
+    protected:
+    /// Appends a byte.
+    void put(uint8_t byte, SortOrder order) {
+        if (length == Size) throw std::length_error("the fields do not fit into the normalized key");
+        encoded.bytes[length++] = order == SortOrder::Descending ? static_cast<uint8_t>(~byte) : byte;
+    }
+
+    /// The key.
+    NormalizedKey<Size> encoded;
+    /// The number of bytes that are used.
+    size_t length = 0;
+};
+
+}  // namespace buzzdb
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <cstdint>
+
+namespace buzzdb {
+
+/// Filters that are pushed down into the range scans of the B-Tree.
+/// A filter provides
+///  - `matches(key, value)`, which evaluates a single entry, and
+///  - `evaluate(keys, values, n, matches)`, which evaluates `n` entries of the
+///    key and value arrays of a leaf at once and sets `matches[i]` to 0 or 1.
+/// `evaluate` is written as plain loops over the arrays without branches, so
+/// that the compiler turns it into vectorized comparisons. The scan compacts
+/// the result into a selection vector and only emits the selected entries.
+
+/// Comparison operators for the filters.
+enum class CompareOp : uint8_t { Equal, NotEqual, Less, LessEqual, Greater, GreaterEqual };
+
+/// Compares every element of a column with a constant.
+/// @param[in]  column   The column.
+/// @param[in]  n        The number of elements.
+/// @param[in]  op       The comparison operator.
+/// @param[in]  constant The right-hand side of the comparison.
+/// @param[out] matches  One byte per element, 1 if the comparison holds.
+template<typename T>
+void compare_column(const T* column, uint32_t n, CompareOp op, const T& constant, uint8_t* matches) {
+    // One loop per operator keeps the loop bodies branch-free.
+    switch (op) {
+        case CompareOp::Equal:
+            for (uint32_t i = 0; i < n; ++i) matches[i] = column[i] == constant;
+            break;
+        case CompareOp::NotEqual:
+            for (uint32_t i = 0; i < n; ++i) matches[i] = column[i] != constant;
+            break;
+        case CompareOp::Less:
+            for (uint32_t i = 0; i < n; ++i) matches[i] = column[i] < constant;
+            break;
+        case CompareOp::LessEqual:
+            for (uint32_t i = 0; i < n; ++i) matches[i] = column[i] <= constant;
+            break;
+        case CompareOp::Greater:
+            for (uint32_t i = 0; i < n; ++i) matches[i] = column[i] > constant;
+            break;
+        case CompareOp::GreaterEqual:
+            for (uint32_t i = 0; i < n; ++i) matches[i] = column[i] >= constant;
+            break;
+    }
+}
+
+/// Compares a value with a constant.
+template<typename T>
+bool compare(const T& value, CompareOp op, const T& constant) {
+    switch (op) {
+        case CompareOp::Equal: return value == constant;
+        case CompareOp::NotEqual: return value != constant;
+        case CompareOp::Less: return value < constant;
+        case CompareOp::LessEqual: return value <= constant;
+        case CompareOp::Greater: return value > constant;
+        case CompareOp::GreaterEqual: return value >= constant;
+    }
+    return false;
+}
+
+/// Accepts every entry.
+struct NoFilter {
+    template<typename KeyT, typename ValueT>
+    bool matches(const KeyT&, const ValueT&) const { return true; }
+
+    template<typename KeyT, typename ValueT>
+    void evaluate(const KeyT*, const ValueT*, uint32_t n, uint8_t* matches) const {
+        for (uint32_t i = 0; i < n; ++i) matches[i] = 1;
+    }
+};
+
+/// Accepts the entries whose value compares to a constant, e.g. `value > 42`.
+template<typename ValueT>
+struct ValueFilter {
+    /// The comparison operator.
+    CompareOp op;
+    /// The right-hand side of the comparison.
+    ValueT constant;
+
+    template<typename KeyT>
+    bool matches(const KeyT&, const ValueT& value) const { return compare(value, op, constant); }
+
+    template<typename KeyT>
+    void evaluate(const KeyT*, const ValueT* values, uint32_t n, uint8_t* matches) const {
+        compare_column(values, n, op, constant, matches);
+    }
+};
+
+/// Accepts the entries whose key compares to a constant.
+/// Useful as a residual predicate on keys that is not a range, e.g. `key != 7`.
+template<typename KeyT>
+struct KeyFilter {
+    /// The comparison operator.
+    CompareOp op;
+    /// The right-hand side of the comparison.
+    KeyT constant;
+
+    template<typename ValueT>
+    bool matches(const KeyT& key, const ValueT&) const { return compare(key, op, constant); }
+
+    template<typename ValueT>
+    void evaluate(const KeyT* keys, const ValueT*, uint32_t n, uint8_t* matches) const {
+        compare_column(keys, n, op, constant, matches);
+    }
+};
+
+/// Accepts the entries with `(key & mask) == pattern` for integer keys.
+template<typename KeyT>
+struct KeyMaskFilter {
+    /// The bits of the key that are checked.
+    KeyT mask;
+    /// The expected values of the checked bits.
+    KeyT pattern;
+
+    template<typename ValueT>
+    bool matches(const KeyT& key, const ValueT&) const { return (key & mask) == pattern; }
+
+    template<typename ValueT>
+    void evaluate(const KeyT* keys, const ValueT*, uint32_t n, uint8_t* matches) const {
+        for (uint32_t i = 0; i < n; ++i) matches[i] = (keys[i] & mask) == pattern;
+    }
+};
+
+/// Accepts the entries that are accepted by both filters.
+template<typename LeftT, typename RightT>
+struct AndFilter {
+    /// The first filter.
+    LeftT left;
+    /// The second filter.
+    RightT right;
+
+    template<typename KeyT, typename ValueT>
+    bool matches(const KeyT& key, const ValueT& value) const {
+        return left.matches(key, value) && right.matches(key, value);
+    }
+
+    template<typename KeyT, typename ValueT>
+    void evaluate(const KeyT* keys, const ValueT* values, uint32_t n, uint8_t* matches) const {
+        left.evaluate(keys, values, n, matches);
+        uint8_t right_matches[64];
+        for (uint32_t offset = 0; offset < n; offset += 64) {
+            uint32_t chunk = n - offset < 64 ? n - offset : 64;
+            right.evaluate(keys + offset, values + offset, chunk, right_matches);
+            for (uint32_t i = 0; i < chunk; ++i) matches[offset + i] &= right_matches[i];
+        }
+    }
+};
+
+/// Creates the conjunction of two filters.
+template<typename LeftT, typename RightT>
+AndFilter<LeftT, RightT> and_filter(const LeftT& left, const RightT& right) {
+    return {left, right};
+}
+
+}  // namespace buzzdb
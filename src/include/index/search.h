@@ -0,0 +1,103 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <type_traits>
+
+namespace buzzdb {
+
+/// Search policies for the sorted key arrays inside the B-Tree nodes.
+/// A policy provides a static `lower_bound(keys, count, key)` that returns the
+/// index of the first key that is not less than `key`, or `count` if there is
+/// no such key.
+
+/// Plain binary search. Works for every key type that provides `operator<`.
+struct BinarySearch {
+    /// Get the index of the first key that is not less than the provided key.
+    /// @param[in] keys      The sorted keys.
+    /// @param[in] count     The number of keys.
+    /// @param[in] key       The key to be checked against.
+    template<typename KeyT>
+    static uint32_t lower_bound(const KeyT* keys, uint32_t count, const KeyT& key) {
+        uint32_t start = 0;
+        uint32_t end = count;
+        while (start < end) {
+            uint32_t center = start + (end - start) / 2;
+            if (keys[center] < key) {
+                start = center + 1;
+            } else {
+                end = center;
+            }
+        }
+        return start;
+    }
+};
+
+/// Interpolation search for integer keys that are close to uniformly
+/// distributed within a node.
+/// The position of the key is guessed from the key range of the array and
+/// verified with a window of `WindowSize` keys around the guess. Once the
+/// remaining range fits into a window, it is finished with a branch-free
+/// linear scan that the compiler can vectorize. If the guesses do not converge
+/// within `MaxRounds` probes, the remaining range is searched with binary
+/// search.
+template<uint32_t WindowSize = 16, uint32_t MaxRounds = 3>
+struct InterpolationSearch {
+    static_assert(WindowSize >= 2, "the window must contain at least two keys");
+
+    /// Get the index of the first key that is not less than the provided key.
+    /// @param[in] keys      The sorted keys.
+    /// @param[in] count     The number of keys.
+    /// @param[in] key       The key to be checked against.
+    template<typename KeyT>
+    static uint32_t lower_bound(const KeyT* keys, uint32_t count, const KeyT& key) {
+        static_assert(std::is_arithmetic_v<KeyT>, "interpolation search requires arithmetic keys");
+        if (count == 0 || !(keys[0] < key)) {
+            return 0;
+        }
+        uint32_t lo = 0;
+        uint32_t hi = count - 1;
+        if (keys[hi] < key) {
+            return count;
+        }
+
+        // Invariant: keys[lo] < key <= keys[hi]
+        uint32_t rounds = 0;
+        while (hi - lo > WindowSize) {
+            if (rounds++ == MaxRounds) {
+                return lo + 1 + BinarySearch::lower_bound(keys + lo + 1, hi - lo, key);
+            }
+            // Dense 64-bit keys may round to the same double, then the span is
+            // zero and the key range does not tell where to look.
+            double span = static_cast<double>(keys[hi]) - static_cast<double>(keys[lo]);
+            double fraction = (static_cast<double>(key) - static_cast<double>(keys[lo])) / span;
+            if (!(span > 0) || !std::isfinite(fraction)) {
+                return lo + 1 + BinarySearch::lower_bound(keys + lo + 1, hi - lo, key);
+            }
+            fraction = std::clamp(fraction, 0.0, 1.0);
+            uint32_t guess = lo + static_cast<uint32_t>(fraction * (hi - lo));
+            guess = std::min(guess, hi);
+            uint32_t window_start = guess > lo + WindowSize / 2 ? guess - WindowSize / 2 : lo;
+            uint32_t window_end = window_start + WindowSize < hi ? window_start + WindowSize : hi;
+
+            if (keys[window_end] < key) {
+                lo = window_end;
+            } else if (!(keys[window_start] < key)) {
+                hi = window_start;
+            } else {
+                lo = window_start;
+                hi = window_end;
+            }
+        }
+
+        // The result lies in (lo, hi], count the keys that are still smaller.
+        uint32_t position = lo + 1;
+        for (uint32_t i = lo + 1; i < hi; ++i) {
+            position += keys[i] < key;
+        }
+        return position;
+    }
+};
+
+}  // namespace buzzdb
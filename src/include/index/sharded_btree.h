@@ -0,0 +1,261 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <queue>
+#include <shared_mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "buffer/buffer_manager.h"
+#include "index/btree.h"
+#include "index/leaf_layout.h"
+
+namespace buzzdb {
+
+/// A front-end that partitions the key space across independent B-Trees.
+/// Every shard is a `BTree` in its own segment with its own latch, so writers
+/// that touch different shards do not contend for a root. Keys are assigned to
+/// shards by hashing or by ranges with adjustable boundaries. Range scans merge
+/// the shards, with range partitioning they are visited in key order, with hash
+/// partitioning the shards are merged batch by batch. Lookups on the same shard
+/// run concurrently.
+/// The remaining template parameters are forwarded to the underlying `BTree`.
+template<typename KeyT, typename ValueT, typename ComparatorT, size_t PageSize,
+         typename... PolicyTs>
+struct ShardedBTree {
+    /// The tree of a shard.
+    using Tree = BTree<KeyT, ValueT, ComparatorT, PageSize, PolicyTs...>;
+
+    /// How keys are assigned to shards.
+    enum class Partitioning : uint8_t { Hash, Range };
+
+    /// A shard.
+    struct Shard {
+        /// Shared for lookups and scans, exclusive for modifications.
+        std::shared_mutex latch;
+        /// The tree.
+        Tree tree;
+
+        /// Constructor.
+        Shard(uint16_t segment_id, BufferManager &buffer_manager)
+            : tree(segment_id, buffer_manager) {}
+    };
+
+    /// The number of entries that a hash partitioned scan reads from a shard at once.
+    static constexpr size_t kScanBatchSize = 256;
+
+    /// How keys are assigned to shards.
+    Partitioning partitioning;
+    /// The shards, shard `i` uses the segment `first_segment_id + i`.
+    std::vector<std::unique_ptr<Shard>> shards;
+    /// With range partitioning, shard `i` holds the keys in
+    /// (boundaries[i - 1], boundaries[i]], the last shard all larger keys.
+    std::vector<KeyT> boundaries;
+
+    /// Constructor for hash partitioning.
+    /// @param[in] first_segment_id   Id of the segment of the first shard.
+    /// @param[in] shard_count        The number of shards.
+    /// @param[in] buffer_manager     The buffer manager that should be used.
+    ShardedBTree(uint16_t first_segment_id, size_t shard_count, BufferManager &buffer_manager)
+        : partitioning(Partitioning::Hash) {
+        for (size_t i = 0; i < std::max<size_t>(shard_count, 1); ++i) {
+            shards.push_back(std::make_unique<Shard>(static_cast<uint16_t>(first_segment_id + i), buffer_manager));
+        }
+    }
+
+    /// Constructor for range partitioning.
+    /// Throws `std::invalid_argument` if the boundaries are not strictly increasing.
+    /// @param[in] first_segment_id   Id of the segment of the first shard.
+    /// @param[in] boundaries         The sorted upper bounds of all shards but
+    ///                               the last one.
+    /// @param[in] buffer_manager     The buffer manager that should be used.
+    ShardedBTree(uint16_t first_segment_id, std::vector<KeyT> boundaries, BufferManager &buffer_manager)
+        : partitioning(Partitioning::Range), boundaries(std::move(boundaries)) {
+        check_increasing(this->boundaries);
+        for (size_t i = 0; i <= this->boundaries.size(); ++i) {
+            shards.push_back(std::make_unique<Shard>(static_cast<uint16_t>(first_segment_id + i), buffer_manager));
+        }
+    }
+
+    /// Throws `std::invalid_argument` unless the boundaries are strictly increasing.
+    static void check_increasing(const std::vector<KeyT> &boundaries) {
+        for (size_t i = 1; i < boundaries.size(); ++i) {
+            if (!(boundaries[i - 1] < boundaries[i])) {
+                throw std::invalid_argument("the shard boundaries must be strictly increasing");
+            }
+        }
+    }
+
+    /// Returns the shard that is responsible for a key.
+    size_t shard_of(const KeyT &key) const {
+        if (partitioning == Partitioning::Hash) {
+            return (key_hash(key) >> 32) % shards.size();
+        }
+        return std::lower_bound(boundaries.begin(), boundaries.end(), key) - boundaries.begin();
+    }
+
+    /// Lookup an entry.
+    /// @param[in] key      The key that should be searched.
+    std::optional<ValueT> lookup(const KeyT &key) {
+        auto& shard = *shards[shard_of(key)];
+        std::shared_lock<std::shared_mutex> guard(shard.latch);
+        return shard.tree.lookup(key);
+    }
+
+    /// Inserts a new entry.
+    /// Lookups, inserts, erases and scans may run concurrently.
+    /// @param[in] key      The key that should be inserted.
+    /// @param[in] value    The value that should be inserted.
+    void insert(const KeyT &key, const ValueT &value) {
+        auto& shard = *shards[shard_of(key)];
+        std::unique_lock<std::shared_mutex> guard(shard.latch);
+        shard.tree.insert(key, value);
+    }
+
+    /// Erase an entry.
+    /// @param[in] key      The key that should be erased.
+    void erase(const KeyT &key) {
+        auto& shard = *shards[shard_of(key)];
+        std::unique_lock<std::shared_mutex> guard(shard.latch);
+        shard.tree.erase(key);
+    }
+
+    /// Inserts, updates or erases an entry depending on its current value, see
+    /// `BTree::upsert()`. The shard stays latched exclusively meanwhile.
+    template<typename FnT>
+    void upsert(const KeyT &key, FnT &&fn) {
+        auto& shard = *shards[shard_of(key)];
+        std::unique_lock<std::shared_mutex> guard(shard.latch);
+        shard.tree.upsert(key, std::forward<FnT>(fn));
+    }
+
+    /// Inserts an entry unless the key is already present, see `BTree::insert_if_absent()`.
+    /// The check and the insert are atomic with respect to the other operations.
+    bool insert_if_absent(const KeyT &key, const ValueT &value) {
+        auto& shard = *shards[shard_of(key)];
+        std::unique_lock<std::shared_mutex> guard(shard.latch);
+        return shard.tree.insert_if_absent(key, value);
+    }
+
+    /// Replaces the value of a key if it equals an expected value, see
+    /// `BTree::compare_and_swap()`. The comparison and the replacement are
+    /// atomic with respect to the other operations.
+    bool compare_and_swap(const KeyT &key, const ValueT &expected, const ValueT &desired) {
+        auto& shard = *shards[shard_of(key)];
+        std::unique_lock<std::shared_mutex> guard(shard.latch);
+        return shard.tree.compare_and_swap(key, expected, desired);
+    }
+
+    /// Scans all entries with keys in [lo, hi] in key order.
+    /// Every shard is only latched while entries are read from it, concurrent
+    /// writes to other parts of the range may or may not be seen.
+    /// @param[in] lo       The smallest key of the range.
+    /// @param[in] hi       The largest key of the range.
+    /// @param[in] consumer Called with the key and value of every entry.
+    template<typename ConsumerT>
+    void scan(const KeyT &lo, const KeyT &hi, ConsumerT &&consumer) {
+        if (hi < lo) return;
+        if (partitioning == Partitioning::Range) {
+            for (size_t i = shard_of(lo); i <= shard_of(hi); ++i) {
+                std::shared_lock<std::shared_mutex> guard(shards[i]->latch);
+                shards[i]->tree.scan(lo, hi, consumer);
+            }
+            return;
+        }
+
+        // Merge the shards, every shard delivers its entries in batches.
+        struct Cursor {
+            std::vector<KeyT> keys;
+            std::vector<ValueT> values;
+            size_t position;
+            size_t count;
+            bool has_more;
+            KeyT next;
+        };
+        std::vector<Cursor> cursors(shards.size());
+        auto refill = [&](size_t i) {
+            auto& cursor = cursors[i];
+            std::shared_lock<std::shared_mutex> guard(shards[i]->latch);
+            auto batch = shards[i]->tree.scan_batch(cursor.next, hi, cursor.keys.data(), cursor.values.data(),
+                                                    kScanBatchSize);
+            cursor.position = 0;
+            cursor.count = batch.count;
+            cursor.has_more = batch.has_more;
+            cursor.next = batch.resume_key;
+            return cursor.count > 0;
+        };
+        auto greater = [&](size_t a, size_t b) {
+            return cursors[b].keys[cursors[b].position] < cursors[a].keys[cursors[a].position];
+        };
+        std::priority_queue<size_t, std::vector<size_t>, decltype(greater)> heads(greater);
+        for (size_t i = 0; i < shards.size(); ++i) {
+            cursors[i].keys.resize(kScanBatchSize);
+            cursors[i].values.resize(kScanBatchSize);
+            cursors[i].next = lo;
+            if (refill(i)) heads.push(i);
+        }
+        while (!heads.empty()) {
+            size_t i = heads.top();
+            heads.pop();
+            auto& cursor = cursors[i];
+            consumer(cursor.keys[cursor.position], cursor.values[cursor.position]);
+            if (++cursor.position < cursor.count || (cursor.has_more && refill(i))) {
+                heads.push(i);
+            }
+        }
+    }
+
+    /// Moves the boundaries of range partitioning.
+    /// The entries that belong to another shard afterwards are moved there with
+    /// one range erase and one merge per shard. Must not run concurrently with
+    /// other operations. Throws `std::invalid_argument` if the tree is hash
+    /// partitioned, or if the boundaries are not strictly increasing or their
+    /// number does not match the shards.
+    /// @param[in] new_boundaries   The sorted upper bounds, one less than shards.
+    void set_boundaries(std::vector<KeyT> new_boundaries) {
+        if (partitioning != Partitioning::Range) {
+            throw std::invalid_argument("only range partitioned trees have boundaries");
+        }
+        if (new_boundaries.size() + 1 != shards.size()) {
+            throw std::invalid_argument("there must be one boundary less than shards");
+        }
+        check_increasing(new_boundaries);
+        boundaries = std::move(new_boundaries);
+
+        // The keys of a shard are sorted and the shards are ordered, so the moved
+        // entries of every target shard are collected in key order.
+        std::vector<std::vector<std::pair<KeyT, ValueT>>> moved(shards.size());
+        for (size_t i = 0; i < shards.size(); ++i) {
+            auto& tree = shards[i]->tree;
+            if (!tree.root) continue;
+            // The entries for lower shards are a prefix, those for higher shards a suffix.
+            std::optional<std::pair<KeyT, KeyT>> below;
+            std::optional<std::pair<KeyT, KeyT>> above;
+            auto collect = [&](typename Tree::LeafNode &leaf, uint32_t) {
+                for (uint32_t slot = 0; slot < leaf.count; ++slot) {
+                    const KeyT& key = leaf.key_at(slot);
+                    size_t target = shard_of(key);
+                    if (target == i) continue;
+                    auto& range = target < i ? below : above;
+                    range = range ? std::make_pair(range->first, key) : std::make_pair(key, key);
+                    moved[target].emplace_back(key, leaf.value_at(slot));
+                }
+                return true;
+            };
+            tree.scan_all_leaves(collect);
+            if (below) tree.erase_range(below->first, below->second);
+            if (above) tree.erase_range(above->first, above->second);
+        }
+        for (size_t i = 0; i < shards.size(); ++i) {
+            shards[i]->tree.merge_from(moved[i]);
+        }
+    }
+};
+
+}  // namespace buzzdb
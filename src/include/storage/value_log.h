@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+
+#include "buffer/buffer_manager.h"
+#include "storage/segment.h"
+
+namespace buzzdb {
+
+/// A compact reference to a value in a `ValueLog`.
+using ValueRef = uint64_t;
+
+/// An append-only segment of fixed-size values.
+/// Values are packed densely into the pages of the segment, so a reference is
+/// just the position of the value in the log. Overwriting a value appends a new
+/// version, the old one stays in the log as garbage.
+template<typename ValueT>
+class ValueLog : public Segment {
+    static_assert(std::is_trivially_copyable_v<ValueT>, "values are copied into pages");
+
+    public:
+    /// Constructor.
+    /// Throws `std::invalid_argument` if a value does not fit into a page.
+    /// @param[in] segment_id       Id of the segment.
+    /// @param[in] buffer_manager   The buffer manager that should be used by the segment.
+    ValueLog(uint16_t segment_id, BufferManager& buffer_manager)
+        : Segment(segment_id, buffer_manager),
+          values_per_page(values_per_page_for(buffer_manager.get_page_size())) {}
+
+    /// Appends a value to the log.
+    /// @param[in] value    The value that should be appended.
+    /// @return             The reference to the value.
+    ValueRef append(const ValueT& value) {
+        ValueRef ref = next_ref++;
+        auto& frame = buffer_manager.fix_page(page_of(ref), true);
+        std::memcpy(slot_of(frame, ref), &value, sizeof(ValueT));
+        buffer_manager.unfix_page(frame, true);
+        return ref;
+    }
+
+    /// Reads a value from the log.
+    /// @param[in] ref      The reference returned by `append()`.
+    ValueT read(ValueRef ref) {
+        ValueT value;
+        auto& frame = buffer_manager.fix_page(page_of(ref), false);
+        std::memcpy(&value, slot_of(frame, ref), sizeof(ValueT));
+        buffer_manager.unfix_page(frame, false);
+        return value;
+    }
+
+    /// Returns the number of values that were appended.
+    uint64_t size() const { return next_ref; }
+
+    protected:
+    /// Returns the number of values in a page of the given size.
+    static uint64_t values_per_page_for(size_t page_size) {
+        if (page_size < sizeof(ValueT)) {
+            throw std::invalid_argument("values of the value log must fit into a page");
+        }
+        return page_size / sizeof(ValueT);
+    }
+
+    /// Returns the page id of the page that contains a value.
+    uint64_t page_of(ValueRef ref) const {
+        return BufferManager::get_overall_page_id(segment_id, ref / values_per_page);
+    }
+
+    /// Returns the location of a value within its page.
+    char* slot_of(BufferFrame& frame, ValueRef ref) const {
+        return frame.get_data() + (ref % values_per_page) * sizeof(ValueT);
+    }
+
+    /// The number of values in one page.
+    uint64_t values_per_page;
+    /// The reference of the next value.
+    ValueRef next_ref = 0;
+};
+
+}  // namespace buzzdb
@@ -1,23 +1,215 @@
 #include <gtest/gtest.h>
 #include <algorithm>
+#include <atomic>
 #include <cstddef>
+#include <map>
 #include <numeric>
 #include <random>
 #include <sstream>
+#include <string>
+#include <tuple>
 #include <vector>
 #include <thread>
 
 #include "common/defer.h"
 #include "index/btree.h"
+#include "index/buffered_btree.h"
+#include "index/kv_separated_btree.h"
+#include "index/normalized_key.h"
+#include "index/sharded_btree.h"
 
 using BufferFrame = buzzdb::BufferFrame;
 using BufferManager = buzzdb::BufferManager;
 using Defer = buzzdb::Defer;
 using BTree =
     buzzdb::BTree<uint64_t, uint64_t, std::less<uint64_t>, 1024>;  // NOLINT
+using InterpolationBTree =
+    buzzdb::BTree<uint64_t, uint64_t, std::less<uint64_t>, 1024,
+                  buzzdb::InterpolationSearch<>>;  // NOLINT
+using BlockedBTree =
+    buzzdb::BTree<uint64_t, uint64_t, std::less<uint64_t>, 1024,
+                  buzzdb::BinarySearch, buzzdb::BlockedInnerLayout>;  // NOLINT
+using LearnedBTree =
+    buzzdb::BTree<uint64_t, uint64_t, std::less<uint64_t>, 1024,
+                  buzzdb::BinarySearch, buzzdb::LearnedInnerLayout>;  // NOLINT
+template <size_t PageSize>
+using BufferedBTree =
+    buzzdb::BufferedBTree<uint64_t, uint64_t, std::less<uint64_t>,
+                          PageSize>;  // NOLINT
+using ShardedBTree =
+    buzzdb::ShardedBTree<uint64_t, uint64_t, std::less<uint64_t>, 1024>;
+template <typename LeafLayoutT>
+using LayoutBTree =
+    buzzdb::BTree<uint64_t, uint64_t, std::less<uint64_t>, 1024,
+                  buzzdb::BinarySearch, buzzdb::SortedInnerLayout,
+                  LeafLayoutT>;  // NOLINT
+using InMemoryBTree =
+    buzzdb::BTree<uint64_t, uint64_t, std::less<uint64_t>, 1024,
+                  buzzdb::BinarySearch, buzzdb::SortedInnerLayout,
+                  buzzdb::SoALeafLayout, buzzdb::InMemoryStorage>;  // NOLINT
+using SwizzledBTree =
+    buzzdb::BTree<uint64_t, uint64_t, std::less<uint64_t>, 1024,
+                  buzzdb::BinarySearch, buzzdb::SortedInnerLayout,
+                  buzzdb::SoALeafLayout, buzzdb::SwizzlingStorage>;  // NOLINT
+using NormalizedKey = buzzdb::NormalizedKey<32>;
+using KeyEncoder = buzzdb::KeyEncoder<32>;
+using SortOrder = buzzdb::SortOrder;
+using NormalizedBTree =
+    buzzdb::BTree<NormalizedKey, uint64_t, std::less<NormalizedKey>,
+                  4096>;  // NOLINT
 
 namespace {
 
+/// Checks filtered range scans against a std::map.
+template <typename Tree>
+void check_filtered_scans() {
+  BufferManager buffer_manager(1024, 100);
+  Tree tree(0, buffer_manager);
+  std::map<uint64_t, uint64_t> expected;
+  std::mt19937_64 engine(0);
+  std::uniform_int_distribution<uint64_t> value_distr(0, 99);
+  for (auto key = 0ul; key < 50 * Tree::LeafNode::kCapacity; key += 3) {
+    auto value = value_distr(engine);
+    tree.insert(key, value);
+    expected[key] = value;
+  }
+
+  auto check = [&](uint64_t lo, uint64_t hi, const auto& filter) {
+    std::vector<std::pair<uint64_t, uint64_t>> result;
+    tree.scan(lo, hi, filter, [&](const uint64_t& key, const uint64_t& value) {
+      result.emplace_back(key, value);
+    });
+    std::vector<std::pair<uint64_t, uint64_t>> reference;
+    for (auto it = expected.lower_bound(lo);
+         it != expected.end() && it->first <= hi; ++it) {
+      if (filter.matches(it->first, it->second)) {
+        reference.emplace_back(*it);
+      }
+    }
+    ASSERT_EQ(result, reference) << "lo=" << lo << " hi=" << hi;
+  };
+  using ValueFilter = buzzdb::ValueFilter<uint64_t>;
+  using KeyMaskFilter = buzzdb::KeyMaskFilter<uint64_t>;
+  check(0, 100000, buzzdb::NoFilter{});
+  check(10, 11, buzzdb::NoFilter{});
+  check(301, 1799, ValueFilter{buzzdb::CompareOp::Less, 10});
+  check(0, 100000, ValueFilter{buzzdb::CompareOp::Equal, 42});
+  check(99, 5000, KeyMaskFilter{0x3, 0x1});
+  check(0, 100000,
+        buzzdb::and_filter(ValueFilter{buzzdb::CompareOp::GreaterEqual, 50},
+                           KeyMaskFilter{0x1, 0x0}));
+  check(500, 400, buzzdb::NoFilter{});
+}
+
+/// Checks batched scans with different batch sizes against a std::map.
+template <typename Tree>
+void check_batched_scans() {
+  BufferManager buffer_manager(1024, 100);
+  Tree tree(0, buffer_manager);
+  std::map<uint64_t, uint64_t> expected;
+  for (auto key = 0ul; key < 50 * Tree::LeafNode::kCapacity; key += 2) {
+    tree.insert(key, 3 * key);
+    expected[key] = 3 * key;
+  }
+  tree.erase_range(1000, 1500);
+  expected.erase(expected.lower_bound(1000), expected.upper_bound(1500));
+
+  for (size_t batch_size : {1ul, 7ul, 42ul, 10000ul}) {
+    uint64_t lo = 99;
+    uint64_t hi = 3001;
+    std::vector<uint64_t> keys(batch_size);
+    std::vector<uint64_t> values(batch_size);
+    std::vector<std::pair<uint64_t, uint64_t>> result;
+    while (true) {
+      auto batch =
+          tree.scan_batch(lo, hi, keys.data(), values.data(), batch_size);
+      ASSERT_LE(batch.count, batch_size);
+      for (size_t i = 0; i < batch.count; ++i) {
+        result.emplace_back(keys[i], values[i]);
+      }
+      if (!batch.has_more) {
+        break;
+      }
+      ASSERT_EQ(batch.count, batch_size);
+      lo = batch.resume_key;
+    }
+    std::vector<std::pair<uint64_t, uint64_t>> reference(
+        expected.lower_bound(99), expected.upper_bound(3001));
+    ASSERT_EQ(result, reference) << "batch_size=" << batch_size;
+  }
+}
+
+/// Checks parallel range scans against a sequential scan.
+template <typename Tree>
+void check_parallel_scans() {
+  BufferManager buffer_manager(1024, 100);
+  Tree tree(0, buffer_manager);
+  std::vector<uint64_t> keys(20000);
+  std::iota(keys.begin(), keys.end(), 0);
+  std::mt19937_64 engine(0);
+  std::shuffle(keys.begin(), keys.end(), engine);
+  for (auto key : keys) {
+    tree.insert(2 * key, key);
+  }
+
+  buzzdb::ThreadPool pool(4);
+  std::vector<std::pair<uint64_t, uint64_t>> ranges = {
+      {0, 40000}, {123, 15001}, {777, 801}, {50000, 60000}};
+  for (auto [lo, hi] : ranges) {
+    for (size_t partitions : {1, 4, 7}) {
+      std::vector<std::vector<std::pair<uint64_t, uint64_t>>> parts(
+          partitions);
+      size_t used = tree.parallel_scan(
+          lo, hi, pool, partitions,
+          [&](size_t partition, const uint64_t& key, uint64_t& value) {
+            parts[partition].emplace_back(key, value);
+          });
+      ASSERT_LE(used, partitions);
+      std::vector<std::pair<uint64_t, uint64_t>> result;
+      for (auto& part : parts) {
+        result.insert(result.end(), part.begin(), part.end());
+      }
+      std::vector<std::pair<uint64_t, uint64_t>> reference;
+      tree.scan(lo, hi, [&](const uint64_t& key, uint64_t& value) {
+        reference.emplace_back(key, value);
+      });
+      ASSERT_EQ(result, reference)
+          << "lo=" << lo << " hi=" << hi << " partitions=" << partitions;
+    }
+  }
+}
+
+/// Inserts, updates and erases random keys and compares against a std::map.
+template <typename Tree, size_t PageSize = 1024>
+void check_random_operations() {
+  BufferManager buffer_manager(PageSize, 100);
+  Tree tree(0, buffer_manager);
+  std::map<uint64_t, uint64_t> expected;
+
+  std::mt19937_64 engine(0);
+  std::uniform_int_distribution<uint64_t> key_distr(0, 2000);
+  for (auto i = 0ul; i < 20 * Tree::LeafNode::kCapacity; ++i) {
+    uint64_t key = key_distr(engine);
+    if (i % 4 == 3) {
+      tree.erase(key);
+      expected.erase(key);
+    } else {
+      tree.insert(key, i);
+      expected[key] = i;
+    }
+  }
+  for (uint64_t key = 0; key <= 2000; ++key) {
+    auto v = tree.lookup(key);
+    auto it = expected.find(key);
+    if (it == expected.end()) {
+      ASSERT_FALSE(v) << "key=" << key << " should not be in the tree";
+    } else {
+      ASSERT_TRUE(v) << "key=" << key << " is missing";
+      ASSERT_EQ(*v, it->second) << "key=" << key << " has a wrong value";
+    }
+  }
+}
+
 TEST(BTreeTest, InsertEmptyTree) {
   BufferManager buffer_manager(1024, 100);
   BTree tree(0, buffer_manager);
@@ -28,7 +220,7 @@ TEST(BTreeTest, InsertEmptyTree) {
   auto test = "inserting an element into an empty B-Tree";
   ASSERT_TRUE(tree.root) << test << " does not create a node.";
 
-  auto root_page = buffer_manager.fix_page(*tree.root, false);
+  auto& root_page = buffer_manager.fix_page(*tree.root, false);
   auto root_node = reinterpret_cast<BTree::Node*>(root_page.get_data());
   Defer root_page_unfix([&]() { buffer_manager.unfix_page(root_page, false); });
 
@@ -51,7 +243,7 @@ TEST(BTreeTest, InsertLeafNode) {
       "inserting BTree::LeafNode::kCapacity elements into an empty B-Tree";
   ASSERT_TRUE(tree.root);
 
-  auto root_page = buffer_manager.fix_page(*tree.root, false);
+  auto& root_page = buffer_manager.fix_page(*tree.root, false);
   auto root_node = reinterpret_cast<BTree::Node*>(root_page.get_data());
   auto root_inner_node = static_cast<BTree::InnerNode*>(root_node);
   Defer root_page_unfix([&]() { buffer_manager.unfix_page(root_page, false); });
@@ -73,10 +265,11 @@ TEST(BTreeTest, InsertLeafNodeSplit) {
   }
 
   ASSERT_TRUE(tree.root);
-  auto root_page = buffer_manager.fix_page(*tree.root, false);
-  auto root_node = reinterpret_cast<BTree::Node*>(root_page.get_data());
+  auto* root_page = &buffer_manager.fix_page(*tree.root, false);
+  auto root_node = reinterpret_cast<BTree::Node*>(root_page->get_data());
   auto root_inner_node = static_cast<BTree::InnerNode*>(root_node);
-  Defer root_page_unfix([&]() { buffer_manager.unfix_page(root_page, false); });
+  Defer root_page_unfix(
+      [&]() { buffer_manager.unfix_page(*root_page, false); });
   ASSERT_TRUE(root_inner_node->is_leaf());
   ASSERT_EQ(root_inner_node->count, BTree::LeafNode::kCapacity);
   root_page_unfix.run();
@@ -89,12 +282,12 @@ TEST(BTreeTest, InsertLeafNodeSplit) {
 
   ASSERT_TRUE(tree.root) << test << " removes the root :-O";
 
-  root_page = buffer_manager.fix_page(*tree.root, false);
+  root_page = &buffer_manager.fix_page(*tree.root, false);
 
-  root_node = reinterpret_cast<BTree::Node*>(root_page.get_data());
+  root_node = reinterpret_cast<BTree::Node*>(root_page->get_data());
   root_inner_node = static_cast<BTree::InnerNode*>(root_node);
   root_page_unfix =
-      Defer([&]() { buffer_manager.unfix_page(root_page, false); });
+      Defer([&]() { buffer_manager.unfix_page(*root_page, false); });
 
   ASSERT_FALSE(root_inner_node->is_leaf())
       << test << " does not create a root inner node";
@@ -272,6 +465,1467 @@ TEST(BTreeTest, Erase) {
   }
 }
 
+TEST(BTreeTest, InterpolationSearchMatchesBinarySearch) {
+  std::mt19937_64 engine(0);
+  std::vector<uint64_t> uniform(500);
+  std::iota(uniform.begin(), uniform.end(), 0);
+  for (auto& k : uniform) {
+    k *= 7;
+  }
+  std::vector<uint64_t> skewed(500);
+  std::uniform_int_distribution<uint64_t> exp_distr(0, 40);
+  for (auto& k : skewed) {
+    k = 1ull << exp_distr(engine);
+  }
+  std::sort(skewed.begin(), skewed.end());
+
+  for (auto* keys : {&uniform, &skewed}) {
+    std::uniform_int_distribution<uint64_t> probe_distr(0, keys->back() + 1);
+    for (auto i = 0; i < 2000; ++i) {
+      uint64_t probe = i < 10 ? (*keys)[i] : probe_distr(engine);
+      for (uint32_t count : {0u, 1u, 5u, 17u, 500u}) {
+        auto expected = static_cast<uint32_t>(
+            std::lower_bound(keys->begin(), keys->begin() + count, probe) -
+            keys->begin());
+        ASSERT_EQ(buzzdb::InterpolationSearch<>::lower_bound(keys->data(),
+                                                              count, probe),
+                  expected)
+            << "probe=" << probe << " count=" << count;
+        ASSERT_EQ(buzzdb::BinarySearch::lower_bound(keys->data(), count, probe),
+                  expected)
+            << "probe=" << probe << " count=" << count;
+      }
+    }
+  }
+}
+
+TEST(BTreeTest, InterpolationSearchDenseKeys) {
+  // Neighbouring keys this large round to the same double.
+  std::vector<uint64_t> keys(500);
+  std::iota(keys.begin(), keys.end(), 1700000000000000000ull);
+  for (uint32_t count : {2u, 17u, 42u, 500u}) {
+    for (uint64_t probe = keys[0] - 1; probe <= keys[count - 1] + 1;
+         ++probe) {
+      auto expected = static_cast<uint32_t>(
+          std::lower_bound(keys.begin(), keys.begin() + count, probe) -
+          keys.begin());
+      ASSERT_EQ(buzzdb::InterpolationSearch<>::lower_bound(keys.data(), count,
+                                                            probe),
+                expected)
+          << "probe=" << probe << " count=" << count;
+    }
+  }
+
+  BufferManager buffer_manager(1024, 100);
+  InterpolationBTree tree(0, buffer_manager);
+  for (auto key : keys) {
+    tree.insert(key, key - keys[0]);
+  }
+  for (auto key : keys) {
+    ASSERT_EQ(tree.lookup(key), key - keys[0]);
+  }
+  ASSERT_FALSE(tree.lookup(keys[0] - 1));
+}
+
+TEST(BTreeTest, InterpolationSearchLookup) {
+  BufferManager buffer_manager(1024, 100);
+  InterpolationBTree tree(0, buffer_manager);
+  auto n = 40 * InterpolationBTree::LeafNode::kCapacity;
+
+  std::vector<uint64_t> keys(n);
+  std::iota(keys.begin(), keys.end(), 0);
+  for (auto& k : keys) {
+    k *= 13;
+  }
+  std::mt19937_64 engine(0);
+  std::shuffle(keys.begin(), keys.end(), engine);
+
+  for (auto i = 0ul; i < n; ++i) {
+    tree.insert(keys[i], 2 * keys[i]);
+  }
+  for (auto i = 0ul; i < n; ++i) {
+    auto v = tree.lookup(keys[i]);
+    ASSERT_TRUE(v) << "key=" << keys[i] << " is missing";
+    ASSERT_EQ(*v, 2 * keys[i]);
+    ASSERT_FALSE(tree.lookup(keys[i] + 1))
+        << "key=" << (keys[i] + 1) << " should not be in the tree";
+  }
+}
+
+TEST(BTreeTest, BlockedInnerLayoutMatchesBinarySearch) {
+  using Index = buzzdb::BlockedInnerLayout::Index<uint64_t, 700>;
+  std::mt19937_64 engine(0);
+  std::uniform_int_distribution<uint64_t> key_distr(0, 10000);
+  std::vector<uint64_t> keys(700);
+  for (auto& k : keys) {
+    k = key_distr(engine);
+  }
+  std::sort(keys.begin(), keys.end());
+
+  Index index{};
+  for (uint32_t count : {0u, 1u, 8u, 9u, 64u, 65u, 300u, 700u}) {
+    index.rebuild(keys.data(), count);
+    for (auto i = 0; i < 1000; ++i) {
+      uint64_t probe = key_distr(engine);
+      auto expected = static_cast<uint32_t>(
+          std::lower_bound(keys.begin(), keys.begin() + count, probe) -
+          keys.begin());
+      ASSERT_EQ(index.lower_bound<buzzdb::BinarySearch>(keys.data(), count,
+                                                        probe),
+                expected)
+          << "probe=" << probe << " count=" << count;
+    }
+  }
+
+  // Modifications are only picked up after rebuilding the index.
+  keys.assign(700, 5);
+  index.rebuild(keys.data(), 700);
+  ASSERT_EQ(index.lower_bound<buzzdb::BinarySearch>(keys.data(), 700, 5), 0);
+  ASSERT_EQ(index.lower_bound<buzzdb::BinarySearch>(keys.data(), 700, 6), 700);
+
+  // An index that was built for another count is not used.
+  ASSERT_EQ(index.lower_bound<buzzdb::BinarySearch>(keys.data(), 300, 6), 300);
+}
+
+TEST(BTreeTest, BlockedInnerLayoutLookup) {
+  BufferManager buffer_manager(1024, 100);
+  BlockedBTree tree(0, buffer_manager);
+  auto n = 40 * BlockedBTree::LeafNode::kCapacity;
+
+  std::vector<uint64_t> keys(n);
+  std::iota(keys.begin(), keys.end(), n);
+  std::mt19937_64 engine(0);
+  std::shuffle(keys.begin(), keys.end(), engine);
+
+  for (auto i = 0ul; i < n; ++i) {
+    tree.insert(keys[i], 2 * keys[i]);
+    ASSERT_TRUE(tree.lookup(keys[i]))
+        << "searching for the just inserted key k=" << keys[i]
+        << " after i=" << i << " inserts yields nothing";
+  }
+  for (auto i = 0ul; i < n; ++i) {
+    auto v = tree.lookup(keys[i]);
+    ASSERT_TRUE(v) << "key=" << keys[i] << " is missing";
+    ASSERT_EQ(*v, 2 * keys[i]);
+  }
+}
+
+TEST(BTreeTest, UpdateInFullLeaf) {
+  // Overwriting any key of a full leaf splits it, the key must not end up in
+  // both halves.
+  for (auto k = 0ul; k < BTree::LeafNode::kCapacity; ++k) {
+    BufferManager buffer_manager(1024, 100);
+    BTree tree(0, buffer_manager);
+    for (auto i = 0ul; i < BTree::LeafNode::kCapacity; ++i) {
+      tree.insert(i, 2 * i);
+    }
+    tree.insert(k, 3 * k);
+
+    auto v = tree.lookup(k);
+    ASSERT_TRUE(v) << "key=" << k << " is missing";
+    ASSERT_EQ(*v, 3 * k) << "key=" << k << " was not overwritten";
+    tree.erase(k);
+    ASSERT_FALSE(tree.lookup(k)) << "key=" << k << " is stored twice";
+  }
+}
+
+TEST(BTreeTest, LeafLayouts) {
+  check_random_operations<LayoutBTree<buzzdb::SoALeafLayout>>();
+  check_random_operations<LayoutBTree<buzzdb::InterleavedLeafLayout>>();
+  check_random_operations<LayoutBTree<buzzdb::FingerprintLeafLayout>>();
+  check_random_operations<LayoutBTree<buzzdb::AdaptiveLeafLayout>>();
+}
+
+TEST(BTreeTest, KVSeparatedLargeValues) {
+  struct LargeValue {
+    uint64_t id;
+    char payload[192];
+  };
+  using Tree = buzzdb::KVSeparatedBTree<uint64_t, LargeValue,
+                                        std::less<uint64_t>, 1024>;
+  BufferManager buffer_manager(1024, 100);
+  Tree tree(1, 2, buffer_manager);
+  auto n = 10 * Tree::Tree::LeafNode::kCapacity;
+
+  std::vector<uint64_t> keys(n);
+  std::iota(keys.begin(), keys.end(), 0);
+  std::mt19937_64 engine(0);
+  std::shuffle(keys.begin(), keys.end(), engine);
+
+  auto make_value = [](uint64_t key, uint64_t version) {
+    LargeValue value{};
+    value.id = key;
+    std::fill(std::begin(value.payload), std::end(value.payload),
+              static_cast<char>('a' + (key + version) % 26));
+    return value;
+  };
+  for (auto key : keys) {
+    tree.insert(key, make_value(key, 0));
+  }
+  for (auto i = 0ul; i < n; i += 2) {
+    tree.insert(keys[i], make_value(keys[i], 1));
+  }
+  for (auto i = 0ul; i < n; i += 3) {
+    tree.erase(keys[i]);
+  }
+
+  // Tree and value log live in different segments.
+  ASSERT_EQ(buzzdb::BufferManager::get_segment_id(*tree.tree.root), 1);
+  for (auto i = 0ul; i < n; ++i) {
+    auto v = tree.lookup(keys[i]);
+    if (i % 3 == 0) {
+      ASSERT_FALSE(v) << "key=" << keys[i] << " was not erased";
+      continue;
+    }
+    ASSERT_TRUE(v) << "key=" << keys[i] << " is missing";
+    auto expected = make_value(keys[i], i % 2 == 0 ? 1 : 0);
+    ASSERT_EQ(v->id, keys[i]);
+    ASSERT_EQ(std::string(v->payload, sizeof(v->payload)),
+              std::string(expected.payload, sizeof(expected.payload)));
+  }
+
+  // Values that are larger than a page are rejected.
+  BufferManager small_pages(128, 10);
+  ASSERT_THROW(buzzdb::ValueLog<LargeValue>(3, small_pages),
+               std::invalid_argument);
+}
+
+TEST(BTreeTest, BufferedRandomOperations) {
+  check_random_operations<BufferedBTree<1024>>();
+  check_random_operations<BufferedBTree<4096>, 4096>();
+}
+
+TEST(BTreeTest, BufferedFlushAll) {
+  BufferManager buffer_manager(1024, 100);
+  BufferedBTree<1024> tree(0, buffer_manager);
+  auto n = 40 * BTree::LeafNode::kCapacity;
+
+  std::vector<uint64_t> keys(n);
+  std::iota(keys.begin(), keys.end(), 0);
+  std::mt19937_64 engine(0);
+  std::shuffle(keys.begin(), keys.end(), engine);
+  for (auto key : keys) {
+    tree.insert(key, 2 * key);
+  }
+  for (auto i = 0ul; i < n; i += 2) {
+    tree.erase(keys[i]);
+  }
+
+  // Messages were also moved between the buffers of inner nodes.
+  auto& root_page = buffer_manager.fix_page(*tree.root, false);
+  ASSERT_GE(reinterpret_cast<BTree::Node*>(root_page.get_data())->level, 2);
+  buffer_manager.unfix_page(root_page, false);
+
+  // After flushing, the plain B-Tree lookup sees all modifications.
+  tree.flush_all();
+  auto& plain = static_cast<BufferedBTree<1024>::Base&>(tree);
+  for (auto i = 0ul; i < n; ++i) {
+    auto v = plain.lookup(keys[i]);
+    if (i % 2 == 0) {
+      ASSERT_FALSE(v) << "key=" << keys[i] << " was not erased";
+    } else {
+      ASSERT_TRUE(v) << "key=" << keys[i] << " is missing";
+      ASSERT_EQ(*v, 2 * keys[i]);
+    }
+  }
+}
+
+TEST(BTreeTest, EraseRange) {
+  BufferManager buffer_manager(1024, 100);
+  BTree tree(0, buffer_manager);
+  auto n = 100 * BTree::LeafNode::kCapacity;
+  std::map<uint64_t, uint64_t> expected;
+
+  std::vector<uint64_t> keys(n);
+  std::iota(keys.begin(), keys.end(), 0);
+  std::mt19937_64 engine(0);
+  std::shuffle(keys.begin(), keys.end(), engine);
+  for (auto key : keys) {
+    tree.insert(key, 2 * key);
+    expected[key] = 2 * key;
+  }
+
+  auto erase_range = [&](uint64_t lo, uint64_t hi) {
+    tree.erase_range(lo, hi);
+    expected.erase(expected.lower_bound(lo), expected.upper_bound(hi));
+  };
+  erase_range(10, 20);
+  erase_range(500, 3000);
+  erase_range(n - 5, n + 100);
+  erase_range(0, 0);
+  ASSERT_FALSE(tree.free_pages.empty())
+      << "erasing a large range does not free any pages";
+
+  for (auto key = 0ul; key < n + 10; ++key) {
+    auto v = tree.lookup(key);
+    ASSERT_EQ(v.has_value(), expected.count(key) == 1) << "key=" << key;
+  }
+
+  // Freed pages are reused before new pages are allocated.
+  for (auto key = 500ul; key <= 3000; ++key) {
+    tree.insert(key, 3 * key);
+    expected[key] = 3 * key;
+  }
+  ASSERT_TRUE(tree.free_pages.empty());
+  for (auto& [key, value] : expected) {
+    auto v = tree.lookup(key);
+    ASSERT_TRUE(v) << "key=" << key << " is missing";
+    ASSERT_EQ(*v, value);
+  }
+
+  // Erasing everything leaves an empty tree that can be filled again.
+  tree.erase_range(0, n);
+  ASSERT_FALSE(tree.lookup(4242));
+  tree.insert(4242, 1);
+  ASSERT_EQ(tree.lookup(4242), 1u);
+}
+
+TEST(BTreeTest, BufferedEraseRange) {
+  BufferManager buffer_manager(1024, 100);
+  BufferedBTree<1024> tree(0, buffer_manager);
+  for (auto key = 0ul; key < 2000; ++key) {
+    tree.insert(key, key);
+  }
+  tree.erase_range(100, 1899);
+  for (auto key = 0ul; key < 2000; ++key) {
+    ASSERT_EQ(tree.lookup(key).has_value(), key < 100 || key >= 1900)
+        << "key=" << key;
+  }
+}
+
+TEST(BTreeTest, BufferedReadPaths) {
+  BufferManager buffer_manager(1024, 100);
+  BufferedBTree<1024> tree(0, buffer_manager);
+  std::map<uint64_t, uint64_t> expected;
+  std::mt19937_64 engine(0);
+  std::uniform_int_distribution<uint64_t> key_distr(0, 3000);
+  uint64_t version = 0;
+  // Every read path is checked right after writes that are still buffered.
+  auto write = [&](size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+      uint64_t key = key_distr(engine);
+      if (i % 3 == 2) {
+        tree.erase(key);
+        expected.erase(key);
+      } else {
+        tree.insert(key, ++version);
+        expected[key] = version;
+      }
+    }
+    ASSERT_TRUE(tree.has_buffered_messages());
+  };
+  auto reference = [&](uint64_t lo, uint64_t hi) {
+    return std::vector<std::pair<uint64_t, uint64_t>>(
+        expected.lower_bound(lo), expected.upper_bound(hi));
+  };
+  write(5000);
+
+  write(100);
+  std::vector<uint64_t> keys(3001);
+  std::iota(keys.begin(), keys.end(), 0);
+  std::vector<std::optional<uint64_t>> found(keys.size());
+  tree.lookup_interleaved(keys.data(), keys.size(), found.data());
+  for (auto key : keys) {
+    auto it = expected.find(key);
+    ASSERT_EQ(found[key], it == expected.end() ? std::nullopt
+                                               : std::optional(it->second))
+        << "key=" << key;
+  }
+
+  write(100);
+  std::vector<std::pair<uint64_t, uint64_t>> result;
+  tree.scan(100, 2500, [&](const uint64_t& key, uint64_t& value) {
+    result.emplace_back(key, value);
+  });
+  ASSERT_EQ(result, reference(100, 2500));
+
+  write(100);
+  result.clear();
+  tree.scan(0, 3000, buzzdb::NoFilter{},
+            [&](const uint64_t& key, const uint64_t& value) {
+              result.emplace_back(key, value);
+            });
+  ASSERT_EQ(result, reference(0, 3000));
+
+  write(100);
+  std::vector<uint64_t> out_keys(keys.size());
+  std::vector<uint64_t> out_values(keys.size());
+  auto batch = tree.scan_batch(0, 3000, out_keys.data(), out_values.data(),
+                               out_keys.size());
+  ASSERT_FALSE(batch.has_more);
+  result.clear();
+  for (size_t i = 0; i < batch.count; ++i) {
+    result.emplace_back(out_keys[i], out_values[i]);
+  }
+  ASSERT_EQ(result, reference(0, 3000));
+
+  write(100);
+  buzzdb::ThreadPool pool(4);
+  std::vector<std::vector<std::pair<uint64_t, uint64_t>>> parts(4);
+  tree.parallel_scan(
+      0, 3000, pool, parts.size(),
+      [&](size_t partition, const uint64_t& key, uint64_t& value) {
+        parts[partition].emplace_back(key, value);
+      });
+  result.clear();
+  for (auto& part : parts) {
+    result.insert(result.end(), part.begin(), part.end());
+  }
+  ASSERT_EQ(result, reference(0, 3000));
+
+  auto cursor = tree.open_cursor(0, 3000);
+  write(100);
+  result.clear();
+  while (size_t count = tree.next_batch(cursor, out_keys.data(),
+                                        out_values.data(), 100)) {
+    for (size_t i = 0; i < count; ++i) {
+      result.emplace_back(out_keys[i], out_values[i]);
+    }
+  }
+  ASSERT_EQ(result, reference(0, 3000));
+
+  // A bulk load replaces the buffered messages, new writes are buffered again.
+  write(100);
+  std::vector<std::pair<uint64_t, uint64_t>> entries;
+  expected.clear();
+  for (uint64_t key = 0; key <= 3000; key += 2) {
+    entries.emplace_back(key, key);
+    expected[key] = key;
+  }
+  tree.build_parallel(entries, pool);
+  ASSERT_FALSE(tree.has_buffered_messages());
+  write(100);
+  for (auto key : keys) {
+    auto it = expected.find(key);
+    ASSERT_EQ(tree.lookup(key), it == expected.end()
+                                    ? std::nullopt
+                                    : std::optional(it->second))
+        << "key=" << key;
+  }
+}
+
+TEST(BTreeTest, FilteredScan) {
+  check_filtered_scans<LayoutBTree<buzzdb::SoALeafLayout>>();
+  check_filtered_scans<LayoutBTree<buzzdb::InterleavedLeafLayout>>();
+  check_filtered_scans<LayoutBTree<buzzdb::FingerprintLeafLayout>>();
+}
+
+TEST(BTreeTest, BatchedScan) {
+  check_batched_scans<LayoutBTree<buzzdb::SoALeafLayout>>();
+  check_batched_scans<LayoutBTree<buzzdb::InterleavedLeafLayout>>();
+}
+
+TEST(BTreeTest, ParallelScan) {
+  check_parallel_scans<BTree>();
+  check_parallel_scans<BlockedBTree>();
+}
+
+TEST(BTreeTest, BuildParallel) {
+  BufferManager buffer_manager(1024, 100);
+  BTree tree(0, buffer_manager);
+  buzzdb::ThreadPool pool(4);
+  tree.insert(123456, 1);
+
+  // Unsorted input with duplicate keys, the last occurrence wins.
+  std::mt19937_64 engine(0);
+  std::uniform_int_distribution<uint64_t> distribution(0, 30000);
+  std::vector<std::pair<uint64_t, uint64_t>> entries;
+  std::map<uint64_t, uint64_t> expected;
+  for (uint64_t i = 0; i < 50000; ++i) {
+    uint64_t key = distribution(engine);
+    entries.emplace_back(key, i);
+    expected[key] = i;
+  }
+  tree.build_parallel(entries, pool);
+
+  std::vector<std::pair<uint64_t, uint64_t>> result;
+  tree.scan(0, 1000000, [&](const uint64_t& key, uint64_t& value) {
+    result.emplace_back(key, value);
+  });
+  std::vector<std::pair<uint64_t, uint64_t>> reference(expected.begin(),
+                                                       expected.end());
+  ASSERT_EQ(result, reference);
+  for (uint64_t key = 0; key <= 30000; ++key) {
+    auto it = expected.find(key);
+    auto value = tree.lookup(key);
+    ASSERT_EQ(value.has_value(), it != expected.end()) << "key=" << key;
+    if (value) {
+      ASSERT_EQ(*value, it->second) << "key=" << key;
+    }
+  }
+
+  // The tree keeps working after the build.
+  for (uint64_t key = 30001; key < 32000; ++key) {
+    tree.insert(key, key);
+    tree.insert(key - 30001, key);
+  }
+  for (uint64_t key = 30001; key < 32000; ++key) {
+    ASSERT_EQ(tree.lookup(key), std::optional<uint64_t>(key));
+    ASSERT_EQ(tree.lookup(key - 30001), std::optional<uint64_t>(key));
+  }
+}
+
+TEST(BTreeTest, MergeFrom) {
+  BufferManager buffer_manager(1024, 100);
+  BTree tree(0, buffer_manager);
+  std::map<uint64_t, uint64_t> expected;
+  std::vector<uint64_t> keys(10000);
+  std::iota(keys.begin(), keys.end(), 0);
+  std::mt19937_64 engine(0);
+  std::shuffle(keys.begin(), keys.end(), engine);
+  for (auto key : keys) {
+    tree.insert(2 * key, key);
+    expected[2 * key] = key;
+  }
+
+  // A sorted run that overlaps the tree, extends it and repeats a key.
+  std::vector<std::pair<uint64_t, uint64_t>> run;
+  for (uint64_t key = 5000; key < 40000; key += 3) {
+    run.emplace_back(key, key + 1);
+    expected[key] = key + 1;
+  }
+  run.emplace_back(40000, 1);
+  run.emplace_back(40000, 2);
+  expected[40000] = 2;
+  tree.merge_from(run);
+
+  // Another tree, merged into a tree and into an empty tree.
+  BTree other(1, buffer_manager);
+  for (uint64_t key = 0; key < 3000; key += 7) {
+    other.insert(key, 7 * key);
+    expected[key] = 7 * key;
+  }
+  tree.merge_from(other);
+  BTree copy(2, buffer_manager);
+  copy.merge_from(tree);
+
+  std::vector<std::pair<uint64_t, uint64_t>> reference(expected.begin(),
+                                                       expected.end());
+  for (auto* t : {&tree, &copy}) {
+    std::vector<std::pair<uint64_t, uint64_t>> result;
+    t->scan(0, 100000, [&](const uint64_t& key, uint64_t& value) {
+      result.emplace_back(key, value);
+    });
+    ASSERT_EQ(result, reference);
+    for (auto& [key, value] : expected) {
+      ASSERT_EQ(t->lookup(key), std::optional<uint64_t>(value));
+    }
+    ASSERT_FALSE(t->lookup(1));
+  }
+}
+
+TEST(BTreeTest, MergeFromBufferedTree) {
+  BufferManager buffer_manager(1024, 100);
+  BufferedBTree<1024> buffered(0, buffer_manager);
+  for (uint64_t key = 0; key < 3000; ++key) {
+    buffered.insert(key, key);
+  }
+  for (uint64_t key = 0; key < 3000; key += 2) {
+    buffered.insert(key, key + 1);
+  }
+  ASSERT_TRUE(buffered.has_buffered_messages());
+
+  // The buffered tree is merged through a reference to the base class.
+  BTree tree(1, buffer_manager);
+  BTree& source = buffered;
+  tree.merge_from(source);
+  ASSERT_FALSE(buffered.has_buffered_messages());
+  for (uint64_t key = 0; key < 3000; ++key) {
+    ASSERT_EQ(tree.lookup(key), key % 2 == 0 ? key + 1 : key)
+        << "key=" << key;
+  }
+}
+
+TEST(BTreeTest, BufferedMergeFrom) {
+  BufferManager buffer_manager(1024, 100);
+  BufferedBTree<1024> tree(0, buffer_manager);
+  std::map<uint64_t, uint64_t> expected;
+  std::mt19937_64 engine(0);
+  std::uniform_int_distribution<uint64_t> key_distr(0, 12000);
+  auto write = [&](BufferedBTree<1024>& t, size_t n, uint64_t value) {
+    for (size_t i = 0; i < n; ++i) {
+      uint64_t key = key_distr(engine);
+      if (i % 4 == 3) {
+        t.erase(key);
+        expected.erase(key);
+      } else {
+        t.insert(key, value);
+        expected[key] = value;
+      }
+    }
+  };
+  write(tree, 5000, 1);
+
+  // The run overrides messages that are still buffered.
+  write(tree, 200, 2);
+  ASSERT_TRUE(tree.has_buffered_messages());
+  std::vector<std::pair<uint64_t, uint64_t>> run;
+  for (uint64_t key = 0; key <= 12000; key += 3) {
+    run.emplace_back(key, 3);
+    expected[key] = 3;
+  }
+  tree.merge_from(run);
+  // The rewritten inner nodes buffer new messages.
+  write(tree, 500, 4);
+
+  // The messages of another buffered tree are merged as well.
+  BufferedBTree<1024> other(1, buffer_manager);
+  for (uint64_t key = 0; key < 3000; ++key) {
+    other.insert(key, 5);
+  }
+  for (uint64_t key = 0; key < 3000; key += 2) {
+    other.insert(key, 6);
+  }
+  ASSERT_TRUE(other.has_buffered_messages());
+  for (uint64_t key = 0; key < 3000; ++key) {
+    expected[key] = key % 2 == 0 ? 6 : 5;
+  }
+  tree.merge_from(other);
+  write(tree, 500, 7);
+
+  for (uint64_t key = 0; key <= 12001; ++key) {
+    auto it = expected.find(key);
+    ASSERT_EQ(tree.lookup(key), it == expected.end()
+                                    ? std::nullopt
+                                    : std::optional(it->second))
+        << "key=" << key;
+  }
+  std::vector<std::pair<uint64_t, uint64_t>> result;
+  tree.scan(0, 12001, [&](const uint64_t& key, uint64_t& value) {
+    result.emplace_back(key, value);
+  });
+  std::vector<std::pair<uint64_t, uint64_t>> reference(expected.begin(),
+                                                       expected.end());
+  ASSERT_EQ(result, reference);
+}
+
+TEST(BTreeTest, Snapshot) {
+  BufferManager buffer_manager(1024, 100);
+  BTree tree(0, buffer_manager);
+  std::map<uint64_t, uint64_t> before;
+  for (uint64_t key = 0; key < 5000; ++key) {
+    tree.insert(key, key);
+    before[key] = key;
+  }
+  std::vector<std::pair<uint64_t, uint64_t>> reference(before.begin(),
+                                                       before.end());
+
+  auto check_snapshot = [&](const BTree::Snapshot& snapshot) {
+    std::vector<std::pair<uint64_t, uint64_t>> result;
+    snapshot.scan(0, 100000, [&](const uint64_t& key, uint64_t& value) {
+      result.emplace_back(key, value);
+    });
+    ASSERT_EQ(result, reference);
+  };
+
+  {
+    auto snapshot = tree.snapshot();
+    std::map<uint64_t, uint64_t> after = before;
+    for (uint64_t key = 5000; key < 8000; ++key) {
+      tree.insert(key, key);
+      after[key] = key;
+    }
+    for (uint64_t key = 0; key < 1000; ++key) {
+      tree.insert(key, key + 1);
+      after[key] = key + 1;
+    }
+    for (uint64_t key = 1000; key < 1500; ++key) {
+      tree.erase(key);
+      after.erase(key);
+    }
+    tree.erase_range(2000, 3999);
+    after.erase(after.lower_bound(2000), after.upper_bound(3999));
+
+    check_snapshot(snapshot);
+    ASSERT_EQ(snapshot.lookup(1234), std::optional<uint64_t>(1234));
+    ASSERT_FALSE(snapshot.lookup(6000));
+    for (uint64_t key = 0; key < 8000; ++key) {
+      auto it = after.find(key);
+      auto value = tree.lookup(key);
+      ASSERT_EQ(value.has_value(), it != after.end()) << "key=" << key;
+      if (value) {
+        ASSERT_EQ(*value, it->second) << "key=" << key;
+      }
+    }
+    ASSERT_FALSE(tree.retired_pages.empty());
+  }
+  ASSERT_TRUE(tree.retired_pages.empty());
+  ASSERT_FALSE(tree.free_pages.empty());
+
+  // A reader of a snapshot runs concurrently with a writer.
+  BTree other(1, buffer_manager);
+  for (uint64_t key = 0; key < 5000; ++key) {
+    other.insert(key, key);
+  }
+  auto snapshot = other.snapshot();
+  std::thread reader([&] {
+    for (int i = 0; i < 5; ++i) {
+      check_snapshot(snapshot);
+    }
+  });
+  for (uint64_t key = 0; key < 10000; ++key) {
+    other.insert(key, key + 1);
+  }
+  reader.join();
+}
+
+TEST(BTreeTest, EpochReclamation) {
+  buzzdb::EpochManager epochs;
+  buzzdb::RetireList<uint64_t> retired;
+  std::vector<uint64_t> reclaimed;
+  auto reclaim = [&]() {
+    epochs.advance();
+    retired.reclaim(epochs.oldest_active(),
+                    [&](uint64_t item) { reclaimed.push_back(item); });
+  };
+  {
+    auto guard = epochs.enter();
+    retired.retire(1, epochs.current());
+    reclaim();
+    ASSERT_TRUE(reclaimed.empty());
+    {
+      // The item is retired in the epoch of the second reader.
+      auto later = epochs.enter();
+      retired.retire(2, epochs.current());
+      reclaim();
+      ASSERT_TRUE(reclaimed.empty());
+    }
+  }
+  reclaim();
+  ASSERT_EQ(reclaimed, (std::vector<uint64_t>{1, 2}));
+
+  // Pages that a tree frees are not reused while a reader is inside an epoch.
+  BufferManager buffer_manager(1024, 100);
+  BTree tree(0, buffer_manager);
+  for (uint64_t key = 0; key < 2000; ++key) {
+    tree.insert(key, key);
+  }
+  {
+    auto guard = buffer_manager.get_epoch_manager().enter();
+    tree.erase_range(100, 1900);
+    ASSERT_TRUE(tree.free_pages.empty());
+    ASSERT_FALSE(tree.pending_pages.empty());
+  }
+  tree.reclaim_pages();
+  ASSERT_TRUE(tree.pending_pages.empty());
+  ASSERT_FALSE(tree.free_pages.empty());
+
+  // Readers do not fix the nodes, the frame of a page that is evicted while a
+  // reader is inside an epoch keeps its content until the reader exits.
+  {
+    auto guard = buffer_manager.get_epoch_manager().enter();
+    auto& frame = buffer_manager.read_page(*tree.root);
+    auto count = reinterpret_cast<BTree::Node*>(frame.get_data())->count;
+    ASSERT_TRUE(buffer_manager.evict_page(*tree.root));
+    ASSERT_EQ(tree.lookup(10), std::optional<uint64_t>(10));
+    ASSERT_TRUE(buffer_manager.evict_page(*tree.root));
+    ASSERT_EQ(reinterpret_cast<BTree::Node*>(frame.get_data())->count, count);
+  }
+  ASSERT_EQ(tree.lookup(1999), std::optional<uint64_t>(1999));
+}
+
+TEST(BTreeTest, ShardedConcurrentInserts) {
+  BufferManager buffer_manager(1024, 100);
+  ShardedBTree tree(1, 8, buffer_manager);
+  std::vector<std::thread> writers;
+  for (uint64_t t = 0; t < 8; ++t) {
+    writers.emplace_back([&tree, t] {
+      for (uint64_t key = t; key < 40000; key += 8) {
+        tree.insert(key, 2 * key);
+      }
+    });
+  }
+  for (auto& writer : writers) {
+    writer.join();
+  }
+
+  for (uint64_t key = 0; key < 40000; key += 7) {
+    ASSERT_EQ(tree.lookup(key), std::optional<uint64_t>(2 * key));
+  }
+  std::vector<uint64_t> keys;
+  tree.scan(100, 30000, [&](const uint64_t& key, uint64_t& value) {
+    ASSERT_EQ(value, 2 * key);
+    keys.push_back(key);
+  });
+  std::vector<uint64_t> expected(30000 - 100 + 1);
+  std::iota(expected.begin(), expected.end(), 100);
+  ASSERT_EQ(keys, expected);
+}
+
+TEST(BTreeTest, ShardedRangeBoundaries) {
+  BufferManager buffer_manager(1024, 100);
+  ShardedBTree tree(1, std::vector<uint64_t>{1000, 2000, 3000},
+                    buffer_manager);
+  for (uint64_t key = 0; key < 4000; ++key) {
+    tree.insert(key, key);
+  }
+  ASSERT_EQ(tree.shard_of(1000), 0u);
+  ASSERT_EQ(tree.shard_of(1001), 1u);
+
+  tree.set_boundaries({500, 2500, 3900});
+  ASSERT_EQ(tree.shard_of(600), 1u);
+  std::vector<uint64_t> keys;
+  tree.scan(0, 10000, [&](const uint64_t& key, uint64_t& value) {
+    ASSERT_EQ(value, key);
+    keys.push_back(key);
+  });
+  std::vector<uint64_t> expected(4000);
+  std::iota(expected.begin(), expected.end(), 0);
+  ASSERT_EQ(keys, expected);
+  for (uint64_t key = 0; key < 4000; ++key) {
+    auto& shard = tree.shards[tree.shard_of(key)]->tree;
+    ASSERT_EQ(shard.lookup(key), std::optional<uint64_t>(key));
+  }
+
+  // Invalid boundaries are rejected and leave the tree unchanged.
+  ASSERT_THROW(tree.set_boundaries({500, 2500}), std::invalid_argument);
+  ASSERT_THROW(tree.set_boundaries({500, 2500, 3900, 4000}),
+               std::invalid_argument);
+  ASSERT_THROW(tree.set_boundaries({500, 500, 3900}), std::invalid_argument);
+  ASSERT_THROW(tree.set_boundaries({2500, 500, 3900}), std::invalid_argument);
+  ASSERT_EQ(tree.boundaries, (std::vector<uint64_t>{500, 2500, 3900}));
+  ASSERT_THROW(ShardedBTree(5, std::vector<uint64_t>{10, 5}, buffer_manager),
+               std::invalid_argument);
+  ShardedBTree hashed(10, 4, buffer_manager);
+  ASSERT_THROW(hashed.set_boundaries({1, 2, 3}), std::invalid_argument);
+}
+
+TEST(BTreeTest, LearnedInnerLayoutMatchesBinarySearch) {
+  using Index = buzzdb::LearnedInnerLayout::Index<uint64_t, 700>;
+  std::mt19937_64 engine(0);
+  std::uniform_int_distribution<uint64_t> key_distr(0, 1000000);
+  std::vector<uint64_t> uniform(700);
+  for (auto& k : uniform) {
+    k = key_distr(engine);
+  }
+  std::sort(uniform.begin(), uniform.end());
+  std::vector<uint64_t> skewed(700);
+  for (uint64_t i = 0; i < skewed.size(); ++i) {
+    skewed[i] = i * i * i;
+  }
+
+  for (auto* keys : {&uniform, &skewed}) {
+    Index index{};
+    for (uint32_t count : {0u, 1u, 2u, 41u, 300u, 700u}) {
+      index.rebuild(keys->data(), count);
+      for (auto i = 0; i < 1000; ++i) {
+        uint64_t probe = key_distr(engine) % (keys->back() + 2);
+        auto expected = static_cast<uint32_t>(
+            std::lower_bound(keys->begin(), keys->begin() + count, probe) -
+            keys->begin());
+        ASSERT_EQ(index.lower_bound<buzzdb::BinarySearch>(keys->data(),
+                                                          count, probe),
+                  expected)
+            << "probe=" << probe << " count=" << count;
+      }
+    }
+  }
+}
+
+TEST(BTreeTest, LearnedInnerLayoutLookup) {
+  BufferManager buffer_manager(1024, 100);
+  LearnedBTree tree(0, buffer_manager);
+  auto n = 40 * LearnedBTree::LeafNode::kCapacity;
+
+  std::vector<uint64_t> keys(n);
+  std::iota(keys.begin(), keys.end(), n);
+  std::mt19937_64 engine(0);
+  std::shuffle(keys.begin(), keys.end(), engine);
+
+  for (auto i = 0ul; i < n; ++i) {
+    tree.insert(keys[i], 2 * keys[i]);
+  }
+  for (auto i = 0ul; i < n; ++i) {
+    auto v = tree.lookup(keys[i]);
+    ASSERT_TRUE(v) << "key=" << keys[i] << " is missing";
+    ASSERT_EQ(*v, 2 * keys[i]);
+  }
+  ASSERT_FALSE(tree.lookup(0));
+  ASSERT_FALSE(tree.lookup(3 * n));
+}
+
+TEST(BTreeTest, AdaptiveLeaves) {
+  using Tree = LayoutBTree<buzzdb::AdaptiveLeafLayout>;
+  BufferManager buffer_manager(1024, 100);
+  Tree tree(0, buffer_manager);
+  std::map<uint64_t, uint64_t> expected;
+  for (uint64_t key = 0; key < 2000; key += 2) {
+    tree.insert(key, key);
+    expected[key] = key;
+  }
+  auto check_lookups = [&]() {
+    for (uint64_t key = 0; key < 2000; ++key) {
+      auto it = expected.find(key);
+      auto value = tree.lookup(key);
+      ASSERT_EQ(value.has_value(), it != expected.end()) << "key=" << key;
+      if (value) {
+        ASSERT_EQ(*value, it->second) << "key=" << key;
+      }
+    }
+  };
+  auto first_leaf = [&]() -> Tree::LeafNode& {
+    uint64_t page_id = *tree.root;
+    while (true) {
+      auto* node = reinterpret_cast<Tree::Node*>(
+          buffer_manager.fix_page(page_id, false).get_data());
+      if (node->is_leaf()) {
+        return *reinterpret_cast<Tree::LeafNode*>(node);
+      }
+      page_id = reinterpret_cast<Tree::InnerNode*>(node)->children[0];
+    }
+  };
+
+  // Lookups do not write to the leaves, the next write after repeated point
+  // lookups switches a leaf to hashing.
+  for (int round = 0; round < 2; ++round) {
+    check_lookups();
+  }
+  ASSERT_FALSE(first_leaf().slots.hashed);
+  tree.insert(0, 0);
+  ASSERT_TRUE(first_leaf().slots.hashed);
+
+  // Scans keep the table, modifications keep the leaves correct.
+  tree.scan(0, 10, [](const uint64_t&, uint64_t&) {});
+  ASSERT_TRUE(first_leaf().slots.hashed);
+  for (uint64_t key = 1; key < 2000; key += 6) {
+    tree.insert(key, 3 * key);
+    expected[key] = 3 * key;
+  }
+  for (uint64_t key = 0; key < 2000; key += 10) {
+    tree.erase(key);
+    expected.erase(key);
+  }
+  for (int round = 0; round < 2; ++round) {
+    check_lookups();
+  }
+  // Rewriting the values after the lookups hashes the leaves again.
+  for (auto& [key, value] : expected) {
+    tree.insert(key, value);
+  }
+  check_lookups();
+
+  // Lookups only write to the counters, so readers can share the leaves.
+  std::vector<std::thread> readers;
+  std::atomic<size_t> found{0};
+  for (int i = 0; i < 4; ++i) {
+    readers.emplace_back([&]() {
+      for (uint64_t key = 0; key < 2000; ++key) {
+        found += tree.lookup(key).has_value();
+      }
+    });
+  }
+  for (auto& reader : readers) {
+    reader.join();
+  }
+  ASSERT_EQ(found.load(), 4 * expected.size());
+}
+
+TEST(BTreeTest, KeyFilter) {
+  BufferManager buffer_manager(1024, 100);
+  BTree tree(0, buffer_manager);
+  tree.enable_key_filter();
+  std::map<uint64_t, uint64_t> expected;
+  auto check_lookups = [&]() {
+    for (uint64_t key = 0; key < 30000; ++key) {
+      auto it = expected.find(key);
+      auto value = tree.lookup(key);
+      ASSERT_EQ(value.has_value(), it != expected.end()) << "key=" << key;
+      if (value) {
+        ASSERT_EQ(*value, it->second) << "key=" << key;
+      }
+    }
+  };
+
+  // More inserts than the filter was sized for make it grow.
+  for (uint64_t key = 0; key < 10000; key += 2) {
+    tree.insert(key, key);
+    expected[key] = key;
+  }
+  ASSERT_GE(tree.key_filter->capacity(), expected.size());
+  check_lookups();
+
+  for (uint64_t key = 0; key < 10000; key += 6) {
+    tree.erase(key);
+    expected.erase(key);
+  }
+  std::vector<std::pair<uint64_t, uint64_t>> run;
+  for (uint64_t key = 20000; key < 25000; ++key) {
+    run.emplace_back(key, 2 * key);
+    expected[key] = 2 * key;
+  }
+  tree.merge_from(run);
+  tree.erase_range(21000, 22000);
+  expected.erase(expected.lower_bound(21000), expected.upper_bound(22000));
+  check_lookups();
+
+  // Most keys that were never inserted are rejected by the filter.
+  size_t false_positives = 0;
+  for (uint64_t key = 100000; key < 200000; ++key) {
+    false_positives += tree.key_filter->may_contain(buzzdb::key_hash(key));
+  }
+  ASSERT_LT(false_positives, 5000u);
+
+  // A large range erase rebuilds the filter, it rejects the erased keys.
+  tree.erase_range(0, 24499);
+  expected.erase(expected.begin(), expected.upper_bound(24499));
+  size_t erased_positives = 0;
+  for (uint64_t key = 0; key < 24500; ++key) {
+    erased_positives += tree.key_filter->may_contain(buzzdb::key_hash(key));
+  }
+  ASSERT_LT(erased_positives, 1000u);
+  check_lookups();
+
+  tree.disable_key_filter();
+  tree.insert(30001, 1);
+  expected[30001] = 1;
+  ASSERT_FALSE(tree.key_filter.has_value());
+  check_lookups();
+}
+
+TEST(BTreeTest, LookupCache) {
+  BufferManager buffer_manager(1024, 100);
+  BTree tree(0, buffer_manager);
+  for (uint64_t key = 0; key < 10000; ++key) {
+    tree.insert(key, key);
+  }
+  tree.enable_lookup_cache(128);
+
+  // Concurrent lookups of a few hot keys among cold ones are mostly hits.
+  std::vector<std::thread> threads;
+  for (uint64_t t = 0; t < 4; ++t) {
+    threads.emplace_back([&tree, t]() {
+      for (uint64_t i = 0; i < 20000; ++i) {
+        uint64_t key = i % 10 == 0 ? (i * 7919 + t) % 10000 : i % 32;
+        auto value = tree.lookup(key);
+        ASSERT_TRUE(value.has_value());
+        ASSERT_EQ(*value, key);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  ASSERT_LE(tree.lookup_cache->size(), 128u + 16u);
+  ASSERT_GT(tree.lookup_cache->stats().hit_rate(), 0.8);
+
+  // Writes are visible through the cache.
+  tree.insert(3, 300);
+  ASSERT_EQ(tree.lookup(3), std::optional<uint64_t>(300));
+  tree.erase(4);
+  ASSERT_FALSE(tree.lookup(4).has_value());
+  tree.merge_from(std::vector<std::pair<uint64_t, uint64_t>>{{5, 500}});
+  ASSERT_EQ(tree.lookup(5), std::optional<uint64_t>(500));
+  tree.erase_range(10, 20);
+  for (uint64_t key = 0; key < 32; ++key) {
+    auto value = tree.lookup(key);
+    ASSERT_EQ(value.has_value(), key != 4 && (key < 10 || key > 20));
+  }
+}
+
+TEST(BTreeTest, InMemoryStorage) {
+  check_random_operations<InMemoryBTree>();
+  check_parallel_scans<InMemoryBTree>();
+
+  // Pages of a parallel build are spread over many chunks of the arena.
+  BufferManager buffer_manager(1024, 100);
+  InMemoryBTree tree(0, buffer_manager);
+  std::vector<std::pair<uint64_t, uint64_t>> entries;
+  for (uint64_t key = 0; key < 100000; ++key) {
+    entries.emplace_back((key * 7919) % 100000, key);
+  }
+  buzzdb::ThreadPool pool(4);
+  tree.build_parallel(entries, pool);
+  ASSERT_GT(tree.next_page_id, InMemoryBTree::Pages::kPagesPerChunk);
+  {
+    auto value = tree.lookup(10);
+    ASSERT_TRUE(value.has_value());
+    auto snapshot = tree.snapshot();
+    tree.erase_range(0, 49999);
+    ASSERT_EQ(snapshot.lookup(10), value);
+  }
+  for (uint64_t key = 0; key < 100000; key += 101) {
+    ASSERT_EQ(tree.lookup(key).has_value(), key >= 50000) << "key=" << key;
+  }
+}
+
+TEST(BTreeTest, PointerSwizzling) {
+  using Pages = SwizzledBTree::Pages;
+  check_random_operations<SwizzledBTree>();
+
+  BufferManager buffer_manager(1024, 100);
+  SwizzledBTree tree(0, buffer_manager);
+  std::map<uint64_t, uint64_t> expected;
+  for (uint64_t key = 0; key < 10000; ++key) {
+    tree.insert((key * 7919) % 10000, key);
+    expected[(key * 7919) % 10000] = key;
+  }
+  auto check_lookups = [&]() {
+    for (uint64_t key = 0; key < 10000; ++key) {
+      auto it = expected.find(key);
+      auto value = tree.lookup(key);
+      ASSERT_EQ(value.has_value(), it != expected.end()) << "key=" << key;
+      if (value) {
+        ASSERT_EQ(*value, it->second) << "key=" << key;
+      }
+    }
+  };
+  auto root_swizzled = [&]() {
+    auto& frame = buffer_manager.fix_page(*tree.root, false);
+    auto* root = reinterpret_cast<SwizzledBTree::InnerNode*>(frame.get_data());
+    bool swizzled = Pages::is_swizzled(root->children[0]);
+    buffer_manager.unfix_page(frame, false);
+    return swizzled;
+  };
+  check_lookups();
+  ASSERT_TRUE(root_swizzled());
+
+  auto evict_all = [&]() {
+    size_t evicted = 0;
+    for (bool progress = true; progress;) {
+      progress = false;
+      for (uint64_t i = 0; i < tree.next_page_id; ++i) {
+        if (buffer_manager.evict_page(
+                BufferManager::get_overall_page_id(0, i))) {
+          ++evicted;
+          progress = true;
+        }
+      }
+    }
+    return evicted;
+  };
+
+  // Evicting everything unswizzles the references bottom-up, inner nodes
+  // with swizzled children are only evicted after them.
+  ASSERT_GE(evict_all(), tree.next_page_id - tree.free_pages.size());
+  ASSERT_FALSE(root_swizzled());
+  check_lookups();
+
+  // A child that is fixed through a swizzled reference is pinned like any
+  // other fixed page and is not evicted.
+  {
+    auto guard = buffer_manager.get_epoch_manager().enter();
+    auto* frame = &tree.pages.fix_page(*tree.root, false);
+    uint64_t child_id = *tree.root;
+    while (!reinterpret_cast<SwizzledBTree::Node*>(frame->get_data())
+                ->is_leaf()) {
+      auto* inner =
+          reinterpret_cast<SwizzledBTree::InnerNode*>(frame->get_data());
+      ASSERT_TRUE(Pages::is_swizzled(inner->children[0]));
+      child_id = inner->child_id(0);
+      auto* child = &tree.pages.fix_child(inner->children[0], false);
+      tree.pages.unfix_page(*frame, false);
+      frame = child;
+    }
+    ASSERT_FALSE(buffer_manager.evict_page(child_id));
+    tree.pages.unfix_page(*frame, false);
+    ASSERT_TRUE(buffer_manager.evict_page(child_id));
+  }
+
+  // Readers that follow a reference which an eviction unswizzles at the same
+  // time fix the page through the page table.
+  std::atomic<bool> evicting{true};
+  std::atomic<size_t> mismatches{0};
+  std::vector<std::thread> readers;
+  for (int t = 0; t < 3; ++t) {
+    readers.emplace_back([&]() {
+      while (evicting) {
+        for (uint64_t key = 0; key < 10000; key += 7) {
+          auto it = expected.find(key);
+          auto value = tree.lookup(key);
+          mismatches += it == expected.end() ? value.has_value()
+                                             : value != it->second;
+        }
+      }
+    });
+  }
+  for (int round = 0; round < 50; ++round) {
+    for (uint64_t i = 0; i < tree.next_page_id; ++i) {
+      buffer_manager.evict_page(BufferManager::get_overall_page_id(0, i));
+    }
+  }
+  evicting = false;
+  for (auto& reader : readers) {
+    reader.join();
+  }
+  ASSERT_EQ(mismatches.load(), 0u);
+  check_lookups();
+
+  for (uint64_t key = 0; key < 10000; key += 3) {
+    tree.erase(key);
+    expected.erase(key);
+  }
+  // The erases unfixed the leaves and their parents again.
+  ASSERT_GE(evict_all(), tree.next_page_id - tree.free_pages.size());
+  check_lookups();
+
+  // Snapshots share the pages, so taking one unswizzles the tree.
+  ASSERT_TRUE(root_swizzled());
+  auto snapshot = tree.snapshot();
+  ASSERT_FALSE(root_swizzled());
+  check_lookups();
+  ASSERT_FALSE(root_swizzled());
+}
+
+/// Counts keys with upserts and compares against a std::map.
+template <typename Tree>
+void check_upserts() {
+  BufferManager buffer_manager(1024, 100);
+  Tree tree(0, buffer_manager);
+  std::map<uint64_t, uint64_t> expected;
+  std::mt19937_64 engine(0);
+  std::uniform_int_distribution<uint64_t> key_distr(0, 2000);
+  for (size_t i = 0; i < 20000; ++i) {
+    uint64_t key = key_distr(engine);
+    // Every fifth access of a key with an odd count removes it again.
+    bool remove = i % 5 == 0;
+    tree.upsert(key, [&](uint64_t* count) -> std::optional<uint64_t> {
+      if (!count) return 1;
+      if (remove && *count % 2 == 1) return std::nullopt;
+      return *count + 1;
+    });
+    auto it = expected.find(key);
+    if (it == expected.end()) {
+      expected[key] = 1;
+    } else if (remove && it->second % 2 == 1) {
+      expected.erase(it);
+    } else {
+      ++it->second;
+    }
+  }
+  // Deleting an absent key does not insert it.
+  tree.upsert(5000, [](uint64_t*) { return std::optional<uint64_t>(); });
+  for (uint64_t key = 0; key <= 5000; ++key) {
+    auto it = expected.find(key);
+    auto value = tree.lookup(key);
+    ASSERT_EQ(value.has_value(), it != expected.end()) << "key=" << key;
+    if (value) {
+      ASSERT_EQ(*value, it->second) << "key=" << key;
+    }
+  }
+}
+
+TEST(BTreeTest, Upsert) {
+  check_upserts<BTree>();
+  check_upserts<BufferedBTree<1024>>();
+}
+
+TEST(BTreeTest, ConditionalWrites) {
+  BufferManager buffer_manager(1024, 100);
+  BTree tree(0, buffer_manager);
+  ASSERT_TRUE(tree.insert_if_absent(1, 10));
+  ASSERT_FALSE(tree.insert_if_absent(1, 20));
+  ASSERT_EQ(tree.lookup(1), std::optional<uint64_t>(10));
+  ASSERT_FALSE(tree.compare_and_swap(1, 20, 30));
+  ASSERT_TRUE(tree.compare_and_swap(1, 10, 30));
+  ASSERT_EQ(tree.lookup(1), std::optional<uint64_t>(30));
+  ASSERT_FALSE(tree.compare_and_swap(2, 0, 1));
+  ASSERT_FALSE(tree.lookup(2).has_value());
+
+  // Threads race for the same keys, exactly one insert of every key wins and
+  // no increment is lost.
+  ShardedBTree sharded(1, 4, buffer_manager);
+  std::atomic<size_t> inserted{0};
+  std::vector<std::thread> threads;
+  for (uint64_t t = 0; t < 4; ++t) {
+    threads.emplace_back([&sharded, &inserted, t]() {
+      for (uint64_t key = 0; key < 2000; ++key) {
+        inserted += sharded.insert_if_absent(key, t) ? 1 : 0;
+      }
+      for (uint64_t i = 0; i < 1000; ++i) {
+        uint64_t key = i % 10;
+        while (true) {
+          uint64_t value = *sharded.lookup(key);
+          if (sharded.compare_and_swap(key, value, value + 4)) break;
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  ASSERT_EQ(inserted.load(), 2000u);
+  for (uint64_t key = 0; key < 10; ++key) {
+    ASSERT_GE(*sharded.lookup(key), 1600u);
+    ASSERT_LT(*sharded.lookup(key), 1604u);
+  }
+}
+
+TEST(BTreeTest, Cursor) {
+  BufferManager buffer_manager(1024, 100);
+  BTree tree(0, buffer_manager);
+  std::map<uint64_t, uint64_t> expected;
+  for (uint64_t key = 0; key < 20000; key += 2) {
+    tree.insert(key, key);
+    expected[key] = key;
+  }
+  std::vector<uint64_t> keys(7);
+  std::vector<uint64_t> values(7);
+
+  // Without modifications, batches continue in place.
+  auto cursor = tree.open_cursor(1001, 15001);
+  size_t batches = 0;
+  std::vector<uint64_t> result;
+  while (size_t count = tree.next_batch(cursor, keys.data(), values.data(),
+                                        keys.size())) {
+    result.insert(result.end(), keys.begin(), keys.begin() + count);
+    ++batches;
+  }
+  ASSERT_TRUE(cursor.done);
+  std::vector<uint64_t> reference;
+  for (auto it = expected.lower_bound(1001); it != expected.upper_bound(15001);
+       ++it) {
+    reference.push_back(it->first);
+  }
+  ASSERT_EQ(result, reference);
+  ASSERT_LT(cursor.descents, batches / 2);
+
+  // Modifications between batches: no key is produced twice or out of order,
+  // every key that is in the range when the cursor passes it is produced.
+  std::mt19937_64 engine(0);
+  std::uniform_int_distribution<uint64_t> key_distr(0, 20000);
+  cursor = tree.open_cursor(0, 20000);
+  std::optional<uint64_t> last;
+  while (size_t count = tree.next_batch(cursor, keys.data(), values.data(),
+                                        keys.size())) {
+    for (size_t i = 0; i < count; ++i) {
+      auto it = last ? expected.upper_bound(*last) : expected.begin();
+      ASSERT_NE(it, expected.end());
+      ASSERT_EQ(keys[i], it->first);
+      ASSERT_EQ(values[i], it->second);
+      last = keys[i];
+    }
+    for (int i = 0; i < 3; ++i) {
+      uint64_t key = key_distr(engine);
+      if (i == 0) {
+        tree.erase(key);
+        expected.erase(key);
+      } else {
+        tree.insert(key, key + 1);
+        expected[key] = key + 1;
+      }
+    }
+  }
+  ASSERT_EQ(expected.upper_bound(*last), expected.end());
+}
+
+/// Checks interleaved lookups against single lookups.
+template <typename Tree>
+void check_interleaved_lookups() {
+  BufferManager buffer_manager(1024, 100);
+  Tree tree(0, buffer_manager);
+  std::vector<uint64_t> keys(5000);
+  std::optional<uint64_t> empty_result;
+  tree.lookup_interleaved(keys.data(), 1, &empty_result);
+  ASSERT_FALSE(empty_result.has_value());
+  for (uint64_t key = 0; key < 10000; key += 2) {
+    tree.insert(key, 3 * key);
+  }
+  std::mt19937_64 engine(0);
+  std::uniform_int_distribution<uint64_t> key_distr(0, 10000);
+  for (auto& key : keys) {
+    key = key_distr(engine);
+  }
+  for (size_t group : {1, 3, 8, 64}) {
+    for (size_t count : {size_t{0}, size_t{2}, keys.size()}) {
+      std::vector<std::optional<uint64_t>> result(count, 1);
+      tree.lookup_interleaved(keys.data(), count, result.data(), group);
+      for (size_t i = 0; i < count; ++i) {
+        ASSERT_EQ(result[i], tree.lookup(keys[i]))
+            << "group=" << group << " key=" << keys[i];
+      }
+    }
+  }
+  tree.enable_key_filter();
+  std::vector<std::optional<uint64_t>> result(keys.size());
+  tree.lookup_interleaved(keys.data(), keys.size(), result.data());
+  for (size_t i = 0; i < keys.size(); ++i) {
+    ASSERT_EQ(result[i], tree.lookup(keys[i])) << "key=" << keys[i];
+  }
+}
+
+TEST(BTreeTest, InterleavedLookups) {
+  check_interleaved_lookups<BTree>();
+  check_interleaved_lookups<InMemoryBTree>();
+  check_interleaved_lookups<SwizzledBTree>();
+}
+
+/// A composite key of an order, its customer and its timestamp.
+using Composite = std::tuple<int32_t, std::string, int64_t>;
+
+/// Encodes a composite key.
+NormalizedKey encode(const Composite& key,
+                     SortOrder time_order = SortOrder::Ascending) {
+  return KeyEncoder()
+      .add_integer(std::get<0>(key))
+      .add_string(std::get<1>(key))
+      .add_integer(std::get<2>(key), time_order)
+      .key();
+}
+
+TEST(BTreeTest, NormalizedKeys) {
+  std::vector<Composite> keys;
+  std::mt19937_64 engine(0);
+  std::uniform_int_distribution<int32_t> id_distr(-3, 3);
+  std::uniform_int_distribution<int64_t> time_distr(-2, 2);
+  std::vector<std::string> names = {"",  "a",   "ab",       "b",
+                                    "\xff", "a\0b", std::string("\0", 1)};
+  for (int i = 0; i < 500; ++i) {
+    keys.emplace_back(id_distr(engine), names[engine() % names.size()],
+                      time_distr(engine) * (int64_t{1} << 40));
+  }
+  keys.emplace_back(INT32_MIN, "", INT64_MIN);
+  keys.emplace_back(INT32_MAX, "b", INT64_MAX);
+  for (auto& a : keys) {
+    for (auto& b : {keys[0], keys[1], keys[keys.size() - 1]}) {
+      ASSERT_EQ(a < b, encode(a) < encode(b));
+      ASSERT_EQ(a == b, encode(a) == encode(b));
+      // A descending timestamp orders equal prefixes newest first.
+      auto prefix = [](const Composite& key) {
+        return std::make_tuple(std::get<0>(key), std::get<1>(key));
+      };
+      bool descending_less =
+          prefix(a) < prefix(b) ||
+          (prefix(a) == prefix(b) && std::get<2>(a) > std::get<2>(b));
+      ASSERT_EQ(descending_less, encode(a, SortOrder::Descending) <
+                                     encode(b, SortOrder::Descending));
+    }
+  }
+  std::vector<double> doubles = {-1e300, -2.5, -0.0, 0.0, 1e-300, 3.0, 1e300};
+  for (size_t i = 0; i + 1 < doubles.size(); ++i) {
+    auto a = KeyEncoder().add_double(doubles[i]).key();
+    auto b = KeyEncoder().add_double(doubles[i + 1]).key();
+    ASSERT_EQ(doubles[i] < doubles[i + 1], a < b);
+  }
+  ASSERT_THROW(KeyEncoder().add_string(std::string(31, 'x')),
+               std::length_error);
+
+  // The tree compares the encoded keys with memcmp.
+  BufferManager buffer_manager(4096, 100);
+  NormalizedBTree tree(0, buffer_manager);
+  std::map<Composite, uint64_t> expected;
+  for (uint64_t i = 0; i < keys.size(); ++i) {
+    tree.insert(encode(keys[i]), i);
+    expected[keys[i]] = i;
+  }
+  for (auto& [key, value] : expected) {
+    ASSERT_EQ(tree.lookup(encode(key)), value);
+  }
+  // All keys of customer "a" of order 0, in tuple order.
+  auto lo = encode({0, "a", INT64_MIN});
+  auto hi = encode({0, "a", INT64_MAX});
+  std::vector<uint64_t> scanned;
+  tree.scan(lo, hi, [&](const NormalizedKey&, uint64_t& value) {
+    scanned.push_back(value);
+  });
+  std::vector<uint64_t> in_range;
+  for (auto it = expected.lower_bound({0, "a", INT64_MIN});
+       it != expected.upper_bound({0, "a", INT64_MAX}); ++it) {
+    in_range.push_back(it->second);
+  }
+  ASSERT_FALSE(in_range.empty());
+  ASSERT_EQ(scanned, in_range);
+}
+
 }  // namespace
 
 int main(int argc, char* argv[]) {